@@ -1,6 +1,9 @@
 #include "app.hpp"
 #include "card_model.hpp"
 #include "config.hpp"
+#include "utility/skipped_list.hpp"
+#include "utility/task.hpp"
+#include <fmt/format.h>
 #include <ncurses.h>
 
 MainWindow::MainWindow(
@@ -9,32 +12,81 @@ MainWindow::MainWindow(
     screen_ptr(screen),
     progressbar_ptr(progressbar_ptr),
     model(std::move(model_)),
-    current_card_idx(current_card_idx)
+    current_card_idx(current_card_idx),
+    debouncer(Config::instance().get_navigation_debounce())
 {
     assert(model->size());
     current_card_idx_changed(-1);
-    skipped_list = Config::get_state<decltype(skipped_list)>("skipped_list");
 }
 
 void MainWindow::paint() const
 {
-    wclear(win);
+    const auto card = model->get_card(current_card_idx).snapshot();
 
-    auto &card = model->get_card(current_card_idx);
+    std::vector<std::string> lines;
+    print(lines, "Front : " + card.front);
+    print(lines, "Back  : " + card.back);
+    print(lines, "PoS   : " + card.pos);
+    print(lines, "Level : " + card.level);
+    if (card.sync_status != Card::SyncStatus::None) {
+        print(lines, "Anki  : " + std::string(to_string(card.sync_status)));
+    }
+    if (!suggestion.empty()) {
+        print(lines, "Maybe : " + suggestion);
+    }
+    if (show_latency) {
+        print(lines, fmt::format("Debug : {}", fmt::join(latency->summary(), ", ")));
+    }
 
-    print("Front : " + card.get_front());
-    print("Back  : " + card.get_back());
-    print("PoS   : " + card.get_pos_string());
-    print("Level : " + card.get_level_string());
+    const size_t height = std::max(get_height(), 1);
+    lines.resize(height - 1);
+    lines.push_back("Left  : " + std::to_string(model->size() - current_card_idx));
+
+    frame.paint(win, lines);
+    if (!pending_key.empty()) {
+        latency->record("key " + pending_key, key_time);
+        pending_key.clear();
+    }
+}
 
-    wmove(win, get_height() - 1, 0);
-    print("Left  : " + std::to_string(model->size() - current_card_idx));
+FrameCache::Stats MainWindow::get_paint_stats() const
+{
+    return frame.get_stats();
+}
 
-    wnoutrefresh(win);
+const LatencyStats &MainWindow::get_latency_stats() const
+{
+    return *latency;
+}
+
+/// Records the time from the keypress to the end of the task, unless it fails
+static Task<void> timed(
+    Task<void> task, std::shared_ptr<LatencyStats> latency, std::string name,
+    LatencyStats::Clock::time_point start)
+{
+    co_await task;
+    latency->record(name, start);
+}
+
+/// Repaints the window once the task has changed the card
+static Task<void> repainted(Task<void> task, std::shared_ptr<UiQueue> ui)
+{
+    co_await task;
+    ui->request_paint();
 }
 
 uint8_t MainWindow::process_key(char32_t ch, bool is_symbol)
 {
+    if (ch == UiQueue::wake_key && is_symbol) {
+        ui->run_posted();
+        return PleasePaint;
+    }
+    if (ch == KEY_RESIZE && !is_symbol) {
+        // The screen may be cleared at the same size, so no row is known to be painted
+        frame.invalidate();
+        return PleasePaint;
+    }
+    key_time = LatencyStats::Clock::now();
     if (ch == 27 && is_symbol) { // escape
         return PleaseExitModal;
     }
@@ -44,6 +96,8 @@ uint8_t MainWindow::process_key(char32_t ch, bool is_symbol)
             auto border = screen->create<st::SimpleBorder>(3, 4);
             auto line = border->create<st::InputLine>("New word: ");
             line->run_modal();
+            // The time spent typing is not the window's latency
+            key_time = LatencyStats::Clock::now();
             if (!line->is_cancelled()) {
                 auto index = model->insert_new_card(line->get_text(), current_card_idx);
                 if (index == current_card_idx) {
@@ -56,16 +110,28 @@ uint8_t MainWindow::process_key(char32_t ch, bool is_symbol)
             }
             border->close();
             screen->show_cursor(false);
+            frame.invalidate();
         }
     }
     else if (ch == 'a' && is_symbol) {
-        model->anki_add_card(model->get_card(current_card_idx));
+        model->anki_queue_add(
+            model->get_card(current_card_idx), [latency = latency, start = key_time] {
+                latency->record("add", start);
+            });
     }
     else if (ch == 'e' && is_symbol) {
-        model->anki_open_browser(model->get_card(current_card_idx));
+        const auto &card = model->get_card(current_card_idx);
+        model->spawn(timed(
+            model->anki_open_browser_async(card.get_front()), latency, "browse",
+            key_time));
     }
     else if (ch == 'r' && is_symbol) {
-        model->anki_reload_card(model->get_card(current_card_idx));
+        auto &card = model->get_card(current_card_idx);
+        model->spawn(repainted(
+            timed(model->anki_reload_card_async(card), latency, "reload", key_time), ui));
+    }
+    else if (ch == 'd' && is_symbol) {
+        show_latency = !show_latency;
     }
     else if (ch == (is_symbol ? 'k' : KEY_UP) || (ch == 'b' && is_symbol)) {
         if (current_card_idx > 0) {
@@ -80,18 +146,38 @@ uint8_t MainWindow::process_key(char32_t ch, bool is_symbol)
     else {
         return 0;
     }
+    if (is_symbol && ch < 0x80) {
+        pending_key = static_cast<char>(ch);
+    }
+    else {
+        pending_key = fmt::format("{:#x}", static_cast<uint32_t>(ch));
+    }
     return PleasePaint;
 }
 
 void MainWindow::save_state()
 {
-    Config::set_state("skipped_list", skipped_list);
+    model->get_skipped_list().compact();
 }
 
-void MainWindow::print(const std::string &str) const
+void MainWindow::print(std::vector<std::string> &lines, const std::string &str) const
 {
-    waddnstr(win, str.c_str(), str.size());
-    waddch(win, '\n');
+    // Wraps at the window width, counting UTF-8 characters
+    const int width = std::max(get_width(), 1);
+    size_t start = 0;
+    int chars = 0;
+    for (size_t idx = 0; idx < str.size(); ++idx) {
+        if ((str[idx] & 0xC0) == 0x80) {
+            continue;
+        }
+        if (chars == width) {
+            lines.push_back(str.substr(start, idx - start));
+            start = idx;
+            chars = 0;
+        }
+        ++chars;
+    }
+    lines.push_back(str.substr(start));
 }
 
 void MainWindow::current_card_idx_changed(size_t prev_card_idx)
@@ -99,20 +185,47 @@ void MainWindow::current_card_idx_changed(size_t prev_card_idx)
     if (auto progress = progressbar_ptr.lock()) {
         progress->set_progres(100.0 * (current_card_idx + 1) / model->size());
     }
-    if (prev_card_idx != static_cast<size_t>(-1)) {
-        model->anki_reload_card(model->get_card(prev_card_idx));
-    }
-    auto word = model->get_card(current_card_idx).get_front();
-    model->say(word);
-    model->look_up_in_safari(word);
+    auto &current_card = model->get_card(current_card_idx);
+    auto word = current_card.get_front();
+    suggestion.clear();
+    // Cards passed over while scrolling are not read aloud. Edits made in Anki
+    // are picked up by the model's change watcher rather than on navigation
+    debouncer.schedule([this, word, suggest = current_card.get_levels().empty(),
+                        start = key_time](std::stop_token token) {
+        // The first suggestion builds the fuzzy index, so it is kept off the UI thread
+        if (suggest) {
+            const auto words = model->suggest_words(word, 3);
+            ui->post([this, word, text = fmt::format("{}", fmt::join(words, ", "))] {
+                if (model->get_card(current_card_idx).get_front() == word) {
+                    suggestion = text;
+                }
+            });
+        }
+        if (token.stop_requested()) {
+            return;
+        }
+        model->say(word);
+        latency->record("say", start);
+        if (token.stop_requested()) {
+            return;
+        }
+        // NSAppleScript only works on the main thread
+        ui->post([this, word, start] {
+            model->look_up_in_safari(word);
+            latency->record("safari", start);
+        });
+    });
     if (current_card_idx > prev_card_idx) {
         const auto &card = model->get_card(prev_card_idx);
-        if (!card.get_note_id()) {
-            skipped_list.insert(card.get_front());
+        // An add still in the write-behind queue has no note id yet
+        const auto status = card.get_sync_status();
+        if (!card.get_note_id() && status != Card::SyncStatus::Pending &&
+            status != Card::SyncStatus::Committed) {
+            model->get_skipped_list().insert(card.get_front());
         }
     }
     else {
-        skipped_list.erase(word);
+        model->get_skipped_list().erase(word);
     }
 }
 
@@ -120,20 +233,26 @@ Footer::Footer() :
     CursesWindow(1)
 {}
 
+uint8_t Footer::process_key(char32_t ch, bool is_symbol)
+{
+    if (ch == KEY_RESIZE && !is_symbol) {
+        frame.invalidate();
+    }
+    return 0;
+}
+
 void Footer::paint() const
 {
-    wclear(win);
-    //    whline(win, '_', get_width());
-    //    wmove(win, 1, 0);
+    std::string line;
     for (const std::string str :
          {"[A]Add", "[I]Insert", "[E]Edit", "[J]Next", "[K]Back", "[R]Reload"}) {
-        //        wattron(win, A_STANDOUT );
-        waddnstr(
-            win, str.c_str(),
-            std::min(str.size(), static_cast<size_t>(get_width() - getcurx(win))));
-        //        wattroff(win, A_STANDOUT);
-        waddch(win, ' ');
-        waddch(win, ' ');
-    }
-    wnoutrefresh(win);
+        line += str + "  ";
+    }
+    line.resize(std::min(line.size(), static_cast<size_t>(std::max(get_width(), 0))));
+    frame.paint(win, {line});
+}
+
+FrameCache::Stats Footer::get_paint_stats() const
+{
+    return frame.get_stats();
 }
@@ -1,10 +1,14 @@
 #ifndef APP_HPP
 #define APP_HPP
 
+#include "utility/debouncer.hpp"
+#include "utility/frame_cache.hpp"
+#include "utility/latency_histogram.hpp"
+#include "utility/ui_queue.hpp"
 #include <st/tiled_ncurses.hpp>
-#include <unordered_set>
 
 
+class Card;
 class CardModel;
 
 namespace ColorScheme {
@@ -29,9 +33,12 @@ public:
     uint8_t process_key(char32_t ch, bool is_symbol) override;
 
     void save_state();
+    FrameCache::Stats get_paint_stats() const;
+    /// Latencies from a keypress to its frame and to the end of its side effects
+    const LatencyStats &get_latency_stats() const;
 
 private:
-    void print(const std::string &str) const;
+    void print(std::vector<std::string> &lines, const std::string &str) const;
     void current_card_idx_changed(size_t prev_card_idx);
 
 private:
@@ -39,8 +46,17 @@ private:
     std::weak_ptr<st::ProgressBar> progressbar_ptr;
     std::shared_ptr<CardModel> model;
     std::string txt;
+    std::string suggestion;
     size_t current_card_idx;
-    std::unordered_set<std::string> skipped_list;
+    mutable FrameCache frame;
+    // Shared with the tasks on the model's event loop, which may outlive the window
+    const std::shared_ptr<LatencyStats> latency = std::make_shared<LatencyStats>();
+    // The key waiting for its frame, with the time it was pressed
+    mutable std::string pending_key;
+    LatencyStats::Clock::time_point key_time = LatencyStats::Clock::now();
+    bool show_latency = false;
+    const std::shared_ptr<UiQueue> ui = std::make_shared<UiQueue>();
+    Debouncer debouncer;
 };
 
 class Footer : public st::CursesWindow
@@ -49,6 +65,11 @@ public:
     Footer();
 
     void paint() const override;
+    uint8_t process_key(char32_t ch, bool is_symbol) override;
+    FrameCache::Stats get_paint_stats() const;
+
+private:
+    mutable FrameCache frame;
 };
 
 #endif // APP_HPP
@@ -3,36 +3,43 @@
 
 std::string Card::get_front() const
 {
+    std::shared_lock lock(mutex);
     return front;
 }
 
 std::string Card::get_back() const
 {
+    std::shared_lock lock(mutex);
     return back;
 }
 
 std::string Card::get_forms() const
 {
+    std::shared_lock lock(mutex);
     return forms;
 }
 
 std::string Card::get_level() const
 {
+    std::shared_lock lock(mutex);
     return levels.empty() ? "D1" : *levels.begin();
 }
 
 string_set Card::get_levels() const
 {
+    std::shared_lock lock(mutex);
     return levels;
 }
 
 string_set Card::get_pos() const
 {
+    std::shared_lock lock(mutex);
     return levels;
 }
 
 string_set Card::get_tags() const
 {
+    std::shared_lock lock(mutex);
     auto result = tags;
     result.insert(levels.begin(), levels.end());
     return result;
@@ -40,25 +47,76 @@ string_set Card::get_tags() const
 
 uint64_t Card::get_note_id() const
 {
+    std::shared_lock lock(mutex);
     return note_id;
 }
 
+int64_t Card::get_note_mod() const
+{
+    std::shared_lock lock(mutex);
+    return note_mod;
+}
+
+Card::SyncStatus Card::get_sync_status() const
+{
+    std::shared_lock lock(mutex);
+    return sync_status;
+}
+
 std::string Card::get_level_string() const
 {
+    std::shared_lock lock(mutex);
     return fmt::format("{}", fmt::join(levels, ", "));
 }
 
 std::string Card::get_pos_string() const
 {
+    std::shared_lock lock(mutex);
     return fmt::format("{}", fmt::join(pos, ", "));
 }
 
 void Card::add_tag(const std::string &tag)
 {
+    std::unique_lock lock(mutex);
     tags.insert(tag);
 }
 
 void Card::set_note_id(uint64_t id)
 {
+    std::unique_lock lock(mutex);
     note_id = id;
 }
+
+void Card::set_note_mod(int64_t mod)
+{
+    std::unique_lock lock(mutex);
+    note_mod = mod;
+}
+
+void Card::set_sync_status(SyncStatus status)
+{
+    std::unique_lock lock(mutex);
+    sync_status = status;
+}
+
+Card::Snapshot Card::snapshot() const
+{
+    std::shared_lock lock(mutex);
+    return {front, back, fmt::format("{}", fmt::join(pos, ", ")),
+            fmt::format("{}", fmt::join(levels, ", ")), sync_status};
+}
+
+const char *to_string(Card::SyncStatus status)
+{
+    switch (status) {
+    case Card::SyncStatus::None:
+        return "";
+    case Card::SyncStatus::Pending:
+        return "pending";
+    case Card::SyncStatus::Committed:
+        return "committed";
+    case Card::SyncStatus::Failed:
+        return "failed";
+    }
+    return "";
+}
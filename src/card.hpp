@@ -1,16 +1,41 @@
 #ifndef CARD_HPP
 #define CARD_HPP
 
+#include <mutex>
 #include <set>
+#include <shared_mutex>
 #include <string>
 
 using string_set = std::set<std::string>;
 using string_set_pair = std::pair<string_set, string_set>;
 using string_set_tuple3 = std::tuple<string_set, string_set, string_set>;
 
+/** The class represents a single vocabulary card
+
+    Every accessor takes the card's own lock, so a background refresh can
+    update a card while the UI reads it. Use snapshot() to read several
+    fields consistently
+*/
 class Card
 {
 public:
+    /// State of the last write of the card to Anki
+    enum class SyncStatus : uint8_t {
+        None,
+        Pending,
+        Committed,
+        Failed,
+    };
+
+    struct Snapshot
+    {
+        std::string front;
+        std::string back;
+        std::string pos;
+        std::string level;
+        SyncStatus sync_status;
+    };
+
     Card() = default;
     ~Card() = default;
     Card(const Card &) = delete;
@@ -26,44 +51,56 @@ public:
     string_set get_pos() const;
     string_set get_tags() const;
     uint64_t get_note_id() const;
+    int64_t get_note_mod() const;
+    SyncStatus get_sync_status() const;
     std::string get_level_string() const;
     std::string get_pos_string() const;
+    Snapshot snapshot() const;
 
     template<typename T>
     void set_front(T &&value)
     {
+        std::unique_lock lock(mutex);
         front = std::forward<T>(value);
     }
 
     template<typename T>
     void set_back(T &&value)
     {
+        std::unique_lock lock(mutex);
         back = std::forward<T>(value);
     }
 
     template<typename T>
     void set_forms(T &&value)
     {
+        std::unique_lock lock(mutex);
         forms = std::forward<T>(value);
     }
 
     template<typename T>
     void set_levels(T &&value)
     {
+        std::unique_lock lock(mutex);
         levels = std::forward<T>(value);
     }
 
     template<typename T>
     void set_pos(T &&value)
     {
+        std::unique_lock lock(mutex);
         pos = std::forward<T>(value);
     }
 
     void add_tag(const std::string &tag);
 
     void set_note_id(uint64_t id);
+    /// The modification time of the note as Anki reported it last
+    void set_note_mod(int64_t mod);
+    void set_sync_status(SyncStatus status);
 
 private:
+    mutable std::shared_mutex mutex;
     std::string front;
     std::string back;
     std::string forms;
@@ -71,7 +108,11 @@ private:
     string_set pos;
     string_set tags;
     uint64_t note_id = 0;
+    int64_t note_mod = 0;
+    SyncStatus sync_status = SyncStatus::None;
 };
 
+const char *to_string(Card::SyncStatus status);
+
 
 #endif // CARD_HPP
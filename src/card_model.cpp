@@ -3,200 +3,843 @@
 #endif
 #include "card_model.hpp"
 #include "config.hpp"
-#include "sqlite_database/sqlite_database.h"
 #include "utility/anki_client.hpp"
+#include "utility/bk_tree.hpp"
+#include "utility/clippings_parser.hpp"
+#include "utility/event_loop.hpp"
 #include "utility/file.hpp"
+#include "utility/lemmatizer.hpp"
+#include "utility/mapped_file.hpp"
+#include "utility/memory_stats.hpp"
+#include "utility/profile_snapshot.hpp"
+#include "utility/skipped_list.hpp"
 #include "utility/speech_engine.hpp"
+#include "utility/sqlite_pool.hpp"
 #include "utility/tools.hpp"
+#include "write_behind_queue.hpp"
+#include <algorithm>
+#include <future>
+#include <thread>
 #include <iostream>
+#include <map>
 #include <regex>
 #include <st/formatter.hpp>
+#include <st/logger.hpp>
 #include <st/string_functions.hpp>
 #include <unordered_set>
 
-CardModel::CardModel()
+// Longer clippings are quotes rather than vocabulary
+constexpr int max_clipping_words = 4;
+
+// Keeps a single AnkiConnect request small enough to stay responsive
+constexpr size_t max_write_batch_size = 50;
+
+// The bound of the queues between the import stages
+constexpr size_t max_import_queue_size = 1024;
+
+static std::string front_query(const std::string &front)
+{
+    return "\"deck:" + Config::get<std::string>("deck") + "\" front:\"" + front + "\"";
+}
+
+/// Makes an action of a multi request
+static nlohmann::json make_action(const char *name, nlohmann::json params)
 {
-    vocabulary_profile_db = SqliteDatabase::open_read_only(
-        Config::instance().get_vocabulary_profile_filepath());
-    if (Config::instance().is_sound_enabled()) {
-        speech = std::make_shared<SpeechEngine>("Daniel");
+    return {
+        {"action", name},
+        {"version", 6},
+        { "params", std::move(params)}
+    };
+}
+
+static nlohmann::json make_add_note_params(const Card &card)
+{
+    const auto deck = Config::get<std::string>("deck");
+    return {
+        {"note",
+         {
+         {"deckName", deck},
+         {"modelName", Config::get<std::string>("card_model")},
+         {"fields", {{"Front", card.get_front()}, {"PoS", card.get_pos_string()}}},
+         {"tags", card.get_tags()},
+         {"options",
+         {{"allowDuplicate", false},
+         {"duplicateScope", "deck"},
+         {"duplicateScopeOptions", {{"deckName", deck}, {"checkChildren", false}}}}},
+         }}
+    };
+}
+
+static nlohmann::json make_update_note_params(const Card &card)
+{
+    return {
+        {"note",
+         {
+         {"id", card.get_note_id()},
+         {"fields",
+         {{"Front", card.get_front()},
+         {"Back", card.get_back()},
+         {"Forms", card.get_forms()},
+         {"PoS", card.get_pos_string()}}},
+         }}
+    };
+}
+
+/// Copies a notesInfo entry to the card, returns true if the fields needed cleanup
+static bool apply_note_info(Card &card, const nlohmann::json &note)
+{
+    bool changed = false;
+    card.set_note_id(note.at("noteId").get<uint64_t>());
+    card.set_note_mod(note.value("mod", int64_t{}));
+    card.set_front(tools::clear_string(
+        note.at("fields").at("Front").at("value").get<std::string>(), changed));
+    card.set_back(tools::clear_string(
+        note.at("fields").at("Back").at("value").get<std::string>(), changed));
+    card.set_pos(tools::split<std::set>(
+        tools::clear_string(
+            note.at("fields").at("PoS").at("value").get<std::string>(), changed),
+        ", "));
+    card.set_forms(tools::clear_string(
+        note.at("fields").at("Forms").at("value").get<std::string>(), changed));
+    return changed;
+}
+
+CardModel::CardModel() = default;
+
+CardModel::~CardModel()
+{
+    if (event_loop) {
+        event_loop->stop();
+        event_loop_thread.join();
     }
-    anki = std::make_shared<AnkiClient>();
-    if (anki->request("version").get<uint64_t>() < 6) {
-        throw std::runtime_error("AnkiConnect plugin is too old. Please update");
+}
+
+void CardModel::warm_up(uint8_t subsystems) const
+{
+    std::vector<std::future<void>> tasks;
+    auto start = [&tasks](auto &&func) {
+        tasks.push_back(std::async(std::launch::async, func));
+    };
+    if (subsystems & Subsystem::ProfileDb) {
+        start([this] {
+            if (!get_profile_snapshot()) {
+                get_profile_db();
+            }
+        });
+    }
+    if (subsystems & Subsystem::ProfileIndex) {
+        start([this] {
+            get_lemmatizer();
+            get_bk_tree();
+        });
+    }
+    if (subsystems & Subsystem::Anki) {
+        start([this] {
+            get_anki();
+        });
+    }
+    if (subsystems & Subsystem::Speech) {
+        start([this] {
+            get_speech();
+        });
+    }
+    for (auto &task : tasks) {
+        task.get();
     }
 }
 
+// Every device starts its history with its own first lookup, whatever the mount
+static std::string read_kindle_device_id(const std::string &filepath)
+{
+    SqlitePool db{filepath};
+    auto &sql = db.query("SELECT id, timestamp FROM LOOKUPS ORDER BY timestamp LIMIT 1");
+    std::string first_lookup;
+    if (sql.step()) {
+        first_lookup = sql.get_string();
+        first_lookup += '/' + std::to_string(sql.get_int64());
+    }
+    return fmt::format("{:016x}", tools::fnv1a_hash(first_lookup));
+}
+
 void CardModel::open_kindle_db()
 {
     const auto db_filepath = Config::instance().get_kindle_db_filepath();
     if (!std::filesystem::exists(db_filepath)) {
         throw std::runtime_error("Please connect your Kindle via USB cable first");
     }
-    kindle_db = SqliteDatabase::open_read_only(db_filepath);
+    // Queries run on a local copy, so the device can be unplugged right away
+    const auto fingerprint = tools::database_fingerprint(db_filepath);
+    const auto fingerprints =
+        Config::get_state<std::map<std::string, std::vector<std::array<uint64_t, 3>>>>(
+            "kindle_db_fingerprints");
+    kindle_device_id.clear();
+    for (const auto &[device_id, device_fingerprint] : fingerprints) {
+        if (device_fingerprint == fingerprint &&
+            std::filesystem::exists(
+                Config::instance().get_kindle_db_copy_filepath(device_id))) {
+            kindle_device_id = device_id;
+            break;
+        }
+    }
+    if (kindle_device_id.empty()) {
+        // The device is known only after its database has been read
+        const auto new_filepath = Config::instance().get_kindle_db_copy_filepath("new");
+        tools::copy_database(db_filepath, new_filepath);
+        kindle_device_id = read_kindle_device_id(new_filepath);
+        tools::move_database(new_filepath,
+            Config::instance().get_kindle_db_copy_filepath(kindle_device_id));
+        Config::set_state("kindle_db_fingerprints", kindle_device_id, fingerprint);
+    }
+    kindle_db = std::make_unique<SqlitePool>(
+        Config::instance().get_kindle_db_copy_filepath(kindle_device_id));
 }
 
 std::vector<std::string> CardModel::get_kindle_booklist() const
 {
     st::assert_or_throw(!!kindle_db, "Kindle database is not open");
     std::vector<std::string> result;
-    auto sql = kindle_db->create_query();
-    sql << "SELECT DISTINCT title FROM BOOK_INFO";
+    auto &sql = kindle_db->query("SELECT DISTINCT title FROM BOOK_INFO");
     while (sql.step()) {
         result.push_back(sql.get_string());
     }
     return result;
 }
 
-void CardModel::load_from_kindle(const std::string &book, size_t &current_card_idx)
+void CardModel::load_from_kindle(
+    const std::string &book, size_t &current_card_idx, bool full_rescan)
 {
     st::assert_or_throw(!!kindle_db, "Kindle database is not open");
-    auto sql = kindle_db->create_query();
-    sql << "SELECT DISTINCT w.stem\n"
-           "FROM WORDS w\n"
-           "JOIN LOOKUPS l ON w.id = l.word_key\n"
-           "JOIN BOOK_INFO b ON l.book_key = b.id\n"
-           "WHERE b.title = ?\n";
+    // Lookups up to the watermark were reviewed in a previous run on this device
+    kindle_watermark_key = kindle_device_id + '/' + book;
+    int64_t watermark = 0;
+    if (!full_rescan) {
+        watermark = Config::get_state<int64_t>("kindle_watermarks", kindle_watermark_key);
+    }
+    kindle_first_lookups.clear();
+    kindle_last_lookup = watermark;
+    auto &sql = kindle_db->query(
+        "SELECT w.stem, MIN(l.timestamp), MAX(l.timestamp)\n"
+        "FROM WORDS w\n"
+        "JOIN LOOKUPS l ON w.id = l.word_key\n"
+        "JOIN BOOK_INFO b ON l.book_key = b.id\n"
+        "WHERE b.title = ? AND l.timestamp > ?\n"
+        "GROUP BY w.stem\n"
+        "ORDER BY MIN(l.timestamp)");
     sql.bind(book);
+    sql.bind(watermark);
+    const auto source = [this, &sql](const auto &emit) {
+        MemoryStats::Scope memory_scope(MemoryStats::Tag::Sqlite);
+        while (sql.step()) {
+            auto word = sql.get_string();
+            const auto first_lookup = sql.get_int64();
+            kindle_last_lookup = std::max(kindle_last_lookup, sql.get_int64());
+            auto it = kindle_first_lookups
+                          .try_emplace(tools::normalize_word(word), first_lookup)
+                          .first;
+            it->second = std::min(it->second, first_lookup);
+            emit(std::move(word));
+        }
+    };
+    if (!load_words(source, "kindle", current_card_idx)) {
+        save_kindle_watermark();
+        throw std::runtime_error("All cards done! No cards left for adding");
+    }
+}
+
+void CardModel::save_kindle_watermark()
+{
+    if (kindle_watermark_key.empty()) {
+        return;
+    }
+    // A card is reviewed once it was added or skipped. Cards that were filtered
+    // out on import aren't in the model. The rest must come back the next time
+    auto kindle_watermark = kindle_last_lookup;
+    auto &skipped = get_skipped_list();
+    for (const auto &[front, first_lookup] : kindle_first_lookups) {
+        const auto idx = cards.find(front);
+        if (!idx) {
+            continue;
+        }
+        const auto &card = cards.at(*idx);
+        if (!card.get_note_id() && card.get_sync_status() == Card::SyncStatus::None &&
+            !skipped.contains(front)) {
+            kindle_watermark = std::min(kindle_watermark, first_lookup - 1);
+        }
+    }
+    if (kindle_watermark >
+        Config::get_state<int64_t>("kindle_watermarks", kindle_watermark_key)) {
+        Config::set_state("kindle_watermarks", kindle_watermark_key, kindle_watermark);
+    }
+}
+
+void CardModel::close_kindle_db()
+{
+    kindle_db.reset();
+}
+
+void CardModel::open_kindle_clippings()
+{
+    const auto filepath = Config::instance().get_kindle_clippings_filepath();
+    if (!std::filesystem::exists(filepath)) {
+        throw std::runtime_error("Please connect your Kindle via USB cable first");
+    }
+    clippings_file = std::make_unique<MappedFile>(filepath);
+}
+
+std::vector<std::string> CardModel::get_clippings_booklist() const
+{
+    st::assert_or_throw(!!clippings_file, "Kindle clippings file is not open");
+    std::vector<std::string> result;
+    std::unordered_set<std::string_view> books;
+    ClippingsParser parser{clippings_file->view()};
+    for (ClippingsParser::Clipping clipping; parser.next(clipping);) {
+        if (books.insert(clipping.book).second) {
+            result.emplace_back(clipping.book);
+        }
+    }
+    return result;
+}
+
+void CardModel::load_from_clippings(const std::string &book, size_t &current_card_idx)
+{
+    st::assert_or_throw(!!clippings_file, "Kindle clippings file is not open");
+    const auto source = [this, &book](const auto &emit) {
+        ClippingsParser parser{clippings_file->view()};
+        for (ClippingsParser::Clipping clipping; parser.next(clipping);) {
+            if (clipping.book != book ||
+                std::count(clipping.text.begin(), clipping.text.end(), ' ') >=
+                    max_clipping_words) {
+                continue;
+            }
+            auto &text = clipping.text;
+            while (!text.empty() && std::ispunct(static_cast<uint8_t>(text.back()))) {
+                text.remove_suffix(1);
+            }
+            while (!text.empty() && std::ispunct(static_cast<uint8_t>(text.front()))) {
+                text.remove_prefix(1);
+            }
+            emit(std::string(text));
+        }
+    };
+    if (!load_words(source, "kindle", current_card_idx)) {
+        throw std::runtime_error("All cards done! No cards left for adding");
+    }
+}
+
+void CardModel::close_kindle_clippings()
+{
+    clippings_file.reset();
+}
+
+bool CardModel::load_words(
+    const WordSource &source, const std::string &tag, size_t &current_card_idx)
+{
+    std::unordered_set<std::string> seen;
     std::unordered_set<uint64_t> ids;
-    while (sql.step()) {
-        auto word = sql.get_string();
-        auto note = anki->request(
-            "findNotes",
-            {
-                {"query",
-                 "\"deck:" + Config::get<std::string>("deck") + "\" front:\"" + word +
-                 "\""}
-        });
-        if (note.empty()) {
-            auto pair = get_word_info(word);
+    // Large enough queues let the Anki check take its batches at the full size
+    CardPipeline pipeline(max_import_queue_size);
+    pipeline
+        .add_stage(
+            "normalize",
+            [](auto &card) {
+                return normalize_card(*card);
+            })
+        .add_stage(
+            "dedup",
+            [this, &seen](auto &card) {
+                auto front = card->get_front();
+                return !cards.find(front) && seen.insert(std::move(front)).second;
+            })
+        .add_batch_stage(
+            "anki",
+            [this, &ids](auto &batch) {
+                std::vector<std::string> queries;
+                for (const auto &card : batch) {
+                    queries.push_back(front_query(card->get_front()));
+                }
+                std::vector<bool> keep;
+                for (const auto &notes : get_anki().find_notes(queries)) {
+                    ids.insert(notes.begin(), notes.end());
+                    keep.push_back(notes.empty());
+                }
+                return keep;
+            },
+            [this] {
+                return get_anki().get_batch_size("findNotes");
+            })
+        .add_stage(
+            "enrich",
+            [this](auto &card) {
+                enrich_card(*card);
+                return true;
+            },
+            std::thread::hardware_concurrency());
+    auto new_cards = pipeline.run([&source, &tag](const auto &emit) {
+        source([&emit, &tag](std::string word) {
+            MemoryStats::Scope memory_scope(MemoryStats::Tag::Cards);
             auto card = std::make_unique<Card>();
             card->set_front(std::move(word));
-            card->set_levels(std::move(pair.first));
-            card->set_pos(std::move(pair.second));
-            card->add_tag("kindle");
-            cards.push_back(std::move(card));
-        }
-        ids.insert(note.begin(), note.end());
-    }
+            card->add_tag(tag);
+            emit(std::move(card));
+        });
+    });
+    import_stats = pipeline.get_stats();
     if (!ids.empty()) {
-        anki->request(
+        get_anki().request(
             "addTags",
             {
-                {"notes",      ids},
-                { "tags", "kindle"}
+                {"notes", ids},
+                { "tags", tag}
         });
     }
-    if (cards.empty()) {
-        throw std::runtime_error("All cards done! No cards left for adding");
+    if (new_cards.empty()) {
+        return !cards.empty();
     }
-    const auto skipped =
-        Config::get_state<std::unordered_set<std::string>>("skipped_list");
-    const auto middle =
-        std::stable_partition(cards.begin(), cards.end(), [&skipped](const auto &card) {
-            return skipped.find(card->get_front()) != skipped.end();
+    // Only the new cards are ranked, so the indices of loaded ones stay put
+    auto &skipped = get_skipped_list();
+    const auto middle = std::stable_partition(
+        new_cards.begin(), new_cards.end(), [&skipped](const auto &card) {
+            return skipped.contains(card->get_front());
         });
-    current_card_idx =
-        middle == cards.end() ? cards.size() - 1 : std::distance(cards.begin(), middle);
-    std::stable_partition(middle, cards.end(), [](const auto &card) {
+    std::stable_partition(middle, new_cards.end(), [](const auto &card) {
         return !card->get_levels().empty();
     });
+    const size_t offset = middle == new_cards.end()
+                              ? new_cards.size() - 1
+                              : std::distance(new_cards.begin(), middle);
+    current_card_idx = cards.append(std::move(new_cards)) + offset;
+    return true;
 }
 
-void CardModel::close_kindle_db()
+void CardModel::load_suspended_cards()
 {
-    kindle_db.reset();
+    const auto deck = Config::get<std::string>("deck");
+    load_notes(anki_read_notes(
+        {.deck = deck,
+         .cards = AnkiCollection::Cards::Suspended,
+         .tag = "leech",
+         .exclude_tag = true},
+        "\"deck:" + deck + "\" is:suspended -tag:leech"));
 }
 
-void CardModel::load_suspended_cards()
+void CardModel::load_leech_cards()
 {
-    for (const auto &note_id : anki->request(
-             "findNotes",
-             {
-                 {"query",
-                  "\"deck:" + Config::get<std::string>("deck") +
-                  "\" is:suspended -tag:leech"}
-    })) {
-        auto card = std::make_unique<Card>();
-        card->set_note_id(note_id.get<uint64_t>());
-        anki_reload_card(*card);
-        cards.push_back(std::move(card));
-    }
+    const auto deck = Config::get<std::string>("deck");
+    load_notes(anki_read_notes(
+        {.deck = deck, .tag = "leech"}, "\"deck:" + deck + "\" tag:leech"));
 }
 
-void CardModel::load_leech_cards()
+void CardModel::load_notes(const nlohmann::json &notes)
 {
-    for (const auto &note_id : anki->request(
-             "findNotes",
-             {
-                 {"query",
-                  "\"deck:" + Config::get<std::string>("deck") + "\" tag:leech"}
-    })) {
-        auto card = std::make_unique<Card>();
-        card->set_note_id(note_id.get<uint64_t>());
-        anki_reload_card(*card);
-        cards.push_back(std::move(card));
+    CardPipeline pipeline;
+    pipeline
+        .add_stage(
+            "dedup",
+            [this](auto &card) {
+                return !cards.find(card->get_front());
+            })
+        .add_stage(
+            "enrich",
+            [this](auto &card) {
+                enrich_card(*card);
+                return true;
+            },
+            std::thread::hardware_concurrency());
+    // Reading a note is the normalization, as it clears the fields
+    auto new_cards = pipeline.run([this, &notes](const auto &emit) {
+        for (const auto &note : notes) {
+            if (note.empty()) {
+                continue;
+            }
+            MemoryStats::Scope memory_scope(MemoryStats::Tag::Cards);
+            auto card = std::make_unique<Card>();
+            // The cleanup is written back once the queue owns the card
+            if (apply_note_info(*card, note)) {
+                card->set_sync_status(Card::SyncStatus::Pending);
+            }
+            emit(std::move(card));
+        }
+    });
+    import_stats = pipeline.get_stats();
+    std::vector<Card *> changed;
+    for (const auto &card : new_cards) {
+        if (card->get_sync_status() == Card::SyncStatus::Pending) {
+            changed.push_back(card.get());
+        }
+    }
+    cards.append(std::move(new_cards));
+    for (auto card : changed) {
+        anki_queue_update(*card);
     }
 }
 
 size_t CardModel::insert_new_card(std::string word, size_t idx)
 {
-    word = tools::clear_string(word);
-    std::transform(word.begin(), word.end(), word.begin(), [](uint8_t c) {
-        return std::tolower(c);
-    });
-    auto it = std::find_if(cards.begin(), cards.end(), [&word](auto &card) {
-        return card->get_front() == word;
-    });
-    if (it == cards.end()) {
-        auto pair = get_word_info(word);
-        auto card = std::make_unique<Card>();
-        card->set_front(std::move(word));
-        card->set_levels(std::move(pair.first));
-        card->set_pos(std::move(pair.second));
-        anki_reload_card(*card);
-        it = cards.insert(cards.begin() + idx, std::move(card));
+    auto card = make_new_card(std::move(word));
+    if (const auto found = cards.find(card->get_front())) {
+        return *found;
+    }
+    anki_reload_card(*card);
+    return cards.insert(idx, std::move(card));
+}
+
+std::unique_ptr<Card> CardModel::make_new_card(std::string word) const
+{
+    // A single card goes through the import stages inline
+    MemoryStats::Scope memory_scope(MemoryStats::Tag::Cards);
+    auto card = std::make_unique<Card>();
+    card->set_front(std::move(word));
+    normalize_card(*card);
+    // An inflected form of a single profile word becomes its base: "geese" -> "goose".
+    // Profile words are kept as typed, the rules also find "be" in "bed"
+    if (find_profile_rows(card->get_front()).empty()) {
+        if (const auto bases = get_lemmatizer().find(card->get_front());
+            bases.size() == 1) {
+            card->set_front(std::string(bases.front()));
+        }
     }
-    return it - cards.begin();
+    enrich_card(*card);
+    return card;
+}
+
+std::vector<PipelineStageStats> CardModel::get_import_stats() const
+{
+    return import_stats;
+}
+
+bool CardModel::normalize_card(Card &card)
+{
+    card.set_front(tools::normalize_word(card.get_front()));
+    return !card.get_front().empty();
+}
+
+void CardModel::enrich_card(Card &card) const
+{
+    // Every worker reads the profile through its own pooled connection
+    auto pair = get_word_info(card.get_front());
+    card.set_levels(std::move(pair.first));
+    card.set_pos(std::move(pair.second));
 }
 
 string_set_pair CardModel::get_word_info(const std::string &word) const
 {
     string_set_pair pair;
-    auto sql = vocabulary_profile_db->create_query();
-    sql << "SELECT level, pos FROM words WHERE base = ?";
-    sql.bind(word);
-    while (sql.step()) {
-        pair.first.insert(sql.get_string());
-        pair.second.insert(sql.get_string());
+    for (auto &entry : find_profile_rows(word)) {
+        pair.first.insert(std::move(entry.level));
+        pair.second.insert(std::move(entry.pos));
+    }
+    if (pair.first.empty()) {
+        for (const auto base : get_lemmatizer().find(word)) {
+            if (base == word) {
+                continue;
+            }
+            auto base_pair = get_word_info(std::string(base));
+            pair.first.merge(base_pair.first);
+            pair.second.merge(base_pair.second);
+        }
     }
     return pair;
 }
 
-void CardModel::query_vocabulary_profile(const std::string &query) const
+std::vector<ProfileEntry> CardModel::find_in_vocabulary_profile(
+    const std::string &query, size_t max_distance) const
 {
-    auto sql = vocabulary_profile_db->create_query();
-    sql << "SELECT base, level, pos, gw\n"
-           "FROM words\n"
-           "WHERE base LIKE ?\n"
-           "ORDER BY base, level, pos";
+    if (max_distance) {
+        return find_in_vocabulary_profile_fuzzy(query, max_distance);
+    }
+    std::vector<ProfileEntry> result;
+    if (const auto snapshot = get_profile_snapshot()) {
+        // Same semantics as LIKE: case-insensitive for ASCII
+        auto equal = [](char lhs, char rhs) {
+            return std::tolower(static_cast<uint8_t>(lhs)) ==
+                   std::tolower(static_cast<uint8_t>(rhs));
+        };
+        for (size_t idx = 0; idx < snapshot->size(); ++idx) {
+            const auto row = snapshot->at(idx);
+            const auto it = std::search(
+                row.base.begin(), row.base.end(), query.begin(), query.end(), equal);
+            if (it != row.base.end()) {
+                result.push_back(
+                    {std::string(row.base), std::string(row.level), std::string(row.pos),
+                     std::string(row.gw)});
+            }
+        }
+        return result;
+    }
+    auto &sql = get_profile_db().query(
+        "SELECT base, level, pos, gw\n"
+        "FROM words\n"
+        "WHERE base LIKE ?\n"
+        "ORDER BY base, level, pos");
     sql.bind("%" + query + "%");
     while (sql.step()) {
-        std::cout << std::left << std::setw(41) << sql.get_string() << std::left
-                  << std::setw(4) << sql.get_string() << std::left << std::setw(10)
-                  << sql.get_string() << std::left << std::setw(16) << sql.get_string()
-                  << std::endl;
+        result.push_back(
+            {sql.get_string(), sql.get_string(), sql.get_string(), sql.get_string()});
+    }
+    return result;
+}
+
+std::vector<ProfileEntry> CardModel::find_in_vocabulary_profile_fuzzy(
+    const std::string &query, size_t max_distance) const
+{
+    std::vector<std::pair<size_t, ProfileEntry>> rows;
+    for (const auto &match : get_bk_tree().find(query, max_distance)) {
+        for (auto &entry : find_profile_rows(std::string(match.word))) {
+            rows.emplace_back(match.distance, std::move(entry));
+        }
+    }
+    std::stable_sort(rows.begin(), rows.end(), [](const auto &lhs, const auto &rhs) {
+        return std::tie(lhs.first, lhs.second.level) <
+               std::tie(rhs.first, rhs.second.level);
+    });
+    std::vector<ProfileEntry> result;
+    result.reserve(rows.size());
+    for (auto &row : rows) {
+        result.push_back(std::move(row.second));
+    }
+    return result;
+}
+
+void CardModel::query_vocabulary_profile(
+    const std::string &query, size_t max_distance) const
+{
+    for (const auto &entry : find_in_vocabulary_profile(query, max_distance)) {
+        std::cout << std::left << std::setw(41) << entry.base << std::left
+                  << std::setw(4) << entry.level << std::left << std::setw(10)
+                  << entry.pos << std::left << std::setw(16) << entry.gw << std::endl;
+    }
+}
+
+std::vector<std::string> CardModel::suggest_words(
+    const std::string &word, size_t count) const
+{
+    std::vector<std::string> result;
+    for (const auto &match : get_bk_tree().find(word, 2)) {
+        if (result.size() == count) {
+            break;
+        }
+        if (match.distance) {
+            result.emplace_back(match.word);
+        }
+    }
+    return result;
+}
+
+void CardModel::build_profile_snapshot() const
+{
+    std::vector<ProfileSnapshot::SourceRow> rows;
+    auto &sql = get_profile_db().query("SELECT base, level, pos, gw FROM words");
+    while (sql.step()) {
+        rows.push_back(
+            {sql.get_string(), sql.get_string(), sql.get_string(), sql.get_string()});
     }
+    ProfileSnapshot::write(
+        Config::instance().get_profile_snapshot_filepath(), get_profile_stamp(),
+        std::move(rows));
+}
+
+std::vector<ProfileEntry> CardModel::find_profile_rows(const std::string &base) const
+{
+    MemoryStats::Scope memory_scope(MemoryStats::Tag::Sqlite);
+    std::vector<ProfileEntry> result;
+    if (const auto snapshot = get_profile_snapshot()) {
+        for (const auto &row : snapshot->find(base)) {
+            result.push_back(
+                {std::string(row.base), std::string(row.level), std::string(row.pos),
+                 std::string(row.gw)});
+        }
+        return result;
+    }
+    auto &sql = get_profile_db().query(
+        "SELECT base, level, pos, gw\n"
+        "FROM words\n"
+        "WHERE base = ?\n"
+        "ORDER BY level, pos");
+    sql.bind(base);
+    while (sql.step()) {
+        result.push_back(
+            {sql.get_string(), sql.get_string(), sql.get_string(), sql.get_string()});
+    }
+    return result;
+}
+
+std::vector<std::string> CardModel::get_profile_bases() const
+{
+    std::vector<std::string> bases;
+    if (const auto snapshot = get_profile_snapshot()) {
+        for (size_t idx = 0; idx < snapshot->size(); ++idx) {
+            const auto base = snapshot->at(idx).base;
+            if (bases.empty() || bases.back() != base) {
+                bases.emplace_back(base);
+            }
+        }
+        return bases;
+    }
+    auto &sql = get_profile_db().query("SELECT DISTINCT base FROM words");
+    while (sql.step()) {
+        bases.push_back(sql.get_string());
+    }
+    return bases;
+}
+
+uint64_t CardModel::get_profile_stamp() const
+{
+    const auto filepath = Config::instance().get_vocabulary_profile_filepath();
+    return std::filesystem::file_size(filepath) * 31 +
+           std::filesystem::last_write_time(filepath).time_since_epoch().count();
+}
+
+const ProfileSnapshot *CardModel::get_profile_snapshot() const
+{
+    std::call_once(profile_snapshot_flag, [this] {
+        const auto filepath = Config::instance().get_profile_snapshot_filepath();
+        if (!std::filesystem::exists(filepath)) {
+            return;
+        }
+        // A stale or unreadable snapshot falls back to the database
+        try {
+            auto snapshot = std::make_unique<ProfileSnapshot>(filepath);
+            if (snapshot->get_stamp() == get_profile_stamp()) {
+                profile_snapshot = std::move(snapshot);
+            }
+        }
+        catch (const std::exception &) {
+        }
+    });
+    return profile_snapshot.get();
+}
+
+SqlitePool &CardModel::get_profile_db() const
+{
+    std::call_once(vocabulary_profile_db_flag, [this] {
+        vocabulary_profile_db = std::make_unique<SqlitePool>(
+            Config::instance().get_vocabulary_profile_filepath());
+    });
+    return *vocabulary_profile_db;
+}
+
+void CardModel::set_anki_tape(std::shared_ptr<AnkiTape> tape)
+{
+    anki_tape = std::move(tape);
+}
+
+AnkiClient &CardModel::get_anki() const
+{
+    std::call_once(anki_flag, [this] {
+        auto client = std::make_shared<AnkiClient>(
+            anki_tape, Config::instance().get_anki_batch_limits());
+        if (client->request("version").get<uint64_t>() < 6) {
+            throw std::runtime_error("AnkiConnect plugin is too old. Please update");
+        }
+        anki = std::move(client);
+    });
+    return *anki;
+}
+
+SpeechEngine *CardModel::get_speech() const
+{
+    std::call_once(speech_flag, [this] {
+        if (Config::instance().is_sound_enabled()) {
+            speech = std::make_shared<SpeechEngine>("Daniel");
+        }
+    });
+    return speech.get();
+}
+
+const AnkiCollection *CardModel::get_collection() const
+{
+    std::call_once(collection_flag, [this] {
+        const auto filepath = Config::instance().get_anki_collection_filepath();
+        if (filepath.empty() || !std::filesystem::exists(filepath)) {
+            return;
+        }
+        try {
+            collection = std::make_unique<AnkiCollection>(filepath);
+        }
+        catch (const std::exception &) {
+        }
+    });
+    return collection.get();
+}
+
+EventLoop &CardModel::get_event_loop() const
+{
+    std::call_once(event_loop_flag, [this] {
+        event_loop = std::make_unique<EventLoop>();
+        event_loop_thread = std::thread([this] {
+            event_loop->run();
+        });
+    });
+    return *event_loop;
+}
+
+WriteBehindQueue &CardModel::get_writer() const
+{
+    std::call_once(writer_flag, [this] {
+        writer = std::make_unique<WriteBehindQueue>(
+            [this](const auto &batch) {
+                anki_write_batch(batch);
+            },
+            max_write_batch_size);
+    });
+    return *writer;
+}
+
+const Lemmatizer &CardModel::get_lemmatizer() const
+{
+    std::call_once(lemmatizer_flag, [this] {
+        lemmatizer = std::make_unique<Lemmatizer>(get_profile_bases());
+    });
+    return *lemmatizer;
+}
+
+const BkTree &CardModel::get_bk_tree() const
+{
+    std::call_once(bk_tree_flag, [this] {
+        // The cached index is valid as long as the profile database is unchanged
+        const auto stamp = get_profile_stamp();
+        const auto index_filepath = Config::instance().get_fuzzy_index_filepath();
+        bk_tree = std::make_unique<BkTree>();
+        if (!bk_tree->load(index_filepath, stamp)) {
+            *bk_tree = BkTree(get_profile_bases());
+            // The index is only a cache, the tree in memory serves the lookups
+            try {
+                bk_tree->save(index_filepath, stamp);
+            }
+            catch (const std::exception &e) {
+                st::log::error("Can't save the fuzzy index: {}", e.what());
+            }
+        }
+    });
+    return *bk_tree;
+}
+
+SkippedList &CardModel::get_skipped_list()
+{
+    std::call_once(skipped_list_flag, [this] {
+        skipped_list =
+            std::make_unique<SkippedList>(Config::instance().get_skipped_list_filepath());
+        const auto legacy =
+            Config::get_state<std::vector<std::string>>("skipped_list");
+        if (!legacy.empty()) {
+            for (const auto &word : legacy) {
+                skipped_list->insert(word);
+            }
+            skipped_list->compact(true);
+        }
+        Config::erase_state("skipped_list");
+    });
+    return *skipped_list;
 }
 
 Card &CardModel::get_card(size_t idx)
 {
-    return *cards.at(idx);
+    return cards.at(idx);
 }
 
 const Card &CardModel::get_card(size_t idx) const
 {
-    return *cards.at(idx);
+    return cards.at(idx);
 }
 
 size_t CardModel::size() const
@@ -206,6 +849,7 @@ size_t CardModel::size() const
 
 void CardModel::look_up_in_safari(const std::string &word)
 {
+    std::lock_guard lock(safari_mutex);
     if (word != last_safari_word) {
 #ifdef __APPLE__
         std::ostringstream ss;
@@ -231,6 +875,7 @@ void CardModel::look_up_in_safari(const std::string &word)
 
 void CardModel::say(const std::string &word) const
 {
+    auto speech = get_speech();
     if (!speech) {
         return;
     }
@@ -247,39 +892,36 @@ void CardModel::say(const std::string &word) const
     if (txt == "read, read, read") {
         txt = "read, red, red";
     }
+    std::lock_guard lock(speech_mutex);
     speech->say(txt);
 }
 
-void CardModel::anki_add_card(Card &card) const
+void CardModel::anki_add_card(Card &card, bool browse) const
 {
-    if (!anki_find_card(card)) {
-        auto tags = card.get_tags();
-        auto note = anki->request(
-            "addNotes",
-            {
-                {"notes",
-                 {{
-                 {"deckName", Config::get<std::string>("deck")},
-                 {"modelName", Config::get<std::string>("card_model")},
-                 {"fields",
-                 {{"Front", card.get_front()}, {"PoS", card.get_pos_string()}}},
-                 {"tags", tags},
-                 }}}
-        });
-        card.set_note_id(note.at(0).get<uint64_t>());
+    // The note is added unless the deck has it, then read back in the same request
+    auto actions = nlohmann::json::array(
+        {make_action("addNote", make_add_note_params(card)),
+         make_action("notesInfo", {{"query", front_query(card.get_front())}})});
+    if (browse) {
+        actions.push_back(
+            make_action("guiBrowse", {{"query", front_query(card.get_front())}}));
+    }
+    const auto results = get_anki().request("multi", {{"actions", actions}});
+    const auto &notes = results.at(1).at("result");
+    if (!notes.is_array() || notes.empty()) {
+        const auto &error = results.at(0).at("error");
+        throw std::runtime_error(
+            "AnkiConnect error: " +
+            (error.is_string() ? error.get<std::string>() : "the note was not added"));
+    }
+    if (apply_note_info(card, notes.at(0))) {
+        anki_queue_update(card);
     }
-    anki_open_browser(card);
 }
 
 void CardModel::anki_open_browser(const Card &card) const
 {
-    anki->request(
-        "guiBrowse",
-        {
-            {"query",
-             "\"deck:" + Config::get<std::string>("deck") + "\" front:\"" +
-             card.get_front() + "\""}
-    });
+    get_anki().request("guiBrowse", {{"query", front_query(card.get_front())}});
 }
 
 void CardModel::anki_reload_card(Card &card) const
@@ -288,60 +930,243 @@ void CardModel::anki_reload_card(Card &card) const
         if (!card.get_note_id()) {
             continue;
         }
-        auto note = anki->request(
-                            "notesInfo",
-                            {
-                                {"notes", {card.get_note_id()}}
-        })
-                        .at(0);
+        // The note might have been edited in Anki since it was cached
+        get_anki().invalidate_notes({card.get_note_id()});
+        auto note = get_anki().notes_info({card.get_note_id()}).at(0);
         if (note.empty()) {
             card.set_note_id(0);
             continue;
         }
-        bool changed = false;
-        card.set_front(tools::clear_string(
-            note.at("fields").at("Front").at("value").get<std::string>(), changed));
-        card.set_back(tools::clear_string(
-            note.at("fields").at("Back").at("value").get<std::string>(), changed));
-        card.set_pos(tools::split<std::set>(
-            tools::clear_string(
-                note.at("fields").at("PoS").at("value").get<std::string>(), changed),
-            ", "));
-        card.set_forms(tools::clear_string(
-            note.at("fields").at("Forms").at("value").get<std::string>(), changed));
-        if (changed) {
-            anki_update_card(card);
+        if (apply_note_info(card, note)) {
+            anki_queue_update(card);
         }
         return;
     } while (anki_find_card(card));
 }
 
+Task<void> CardModel::anki_open_browser_async(std::string front) const
+{
+    nlohmann::json params{{"query", front_query(front)}};
+    co_await get_anki().async_request(get_event_loop(), "guiBrowse", std::move(params));
+}
+
+Task<void> CardModel::anki_reload_card_async(Card &card) const
+{
+    // A single request finds the note by the front, even if its id has changed
+    auto &anki = get_anki();
+    nlohmann::json params{{"query", front_query(card.get_front())}};
+    const auto notes =
+        co_await anki.async_request(get_event_loop(), "notesInfo", std::move(params));
+    if (const auto note_id = card.get_note_id()) {
+        anki.invalidate_notes({note_id});
+    }
+    if (notes.empty()) {
+        card.set_note_id(0);
+        co_return;
+    }
+    if (apply_note_info(card, notes.at(0))) {
+        anki_queue_update(card);
+    }
+}
+
+Task<void> CardModel::anki_watch_changes() const
+{
+    auto &loop = get_event_loop();
+    auto &anki = get_anki();
+    const auto interval = Config::instance().get_anki_poll_interval();
+    bool failing = false;
+    while (true) {
+        co_await loop.sleep_for(interval);
+        std::unordered_map<uint64_t, Card *> loaded;
+        for (size_t idx = 0; idx < cards.size(); ++idx) {
+            auto &card = cards.at(idx);
+            // The writer reads back the notes it has queued
+            if (card.get_note_id() &&
+                card.get_sync_status() != Card::SyncStatus::Pending) {
+                loaded.emplace(card.get_note_id(), &card);
+            }
+        }
+        // The responses cached by the client go stale the same way
+        auto cached = anki.get_cached_note_mods();
+        if (loaded.empty() && cached.empty()) {
+            continue;
+        }
+        try {
+            std::vector<uint64_t> note_ids;
+            for (const auto &[note_id, card] : loaded) {
+                note_ids.push_back(note_id);
+            }
+            for (const auto &[note_id, mod] : cached) {
+                if (!loaded.contains(note_id)) {
+                    note_ids.push_back(note_id);
+                }
+            }
+            nlohmann::json params{{"notes", note_ids}};
+            const auto mods =
+                co_await anki.async_request(loop, "notesModTime", std::move(params));
+            std::unordered_set<uint64_t> changed(note_ids.begin(), note_ids.end());
+            std::vector<uint64_t> stale;
+            for (const auto &item : mods) {
+                const auto note_id = item.at("noteId").get<uint64_t>();
+                const auto mod = item.at("mod").get<int64_t>();
+                if (auto it = cached.find(note_id); it != cached.end()) {
+                    if (it->second != mod) {
+                        stale.push_back(note_id);
+                    }
+                    cached.erase(it);
+                }
+                auto it = loaded.find(note_id);
+                if (it == loaded.end()) {
+                    changed.erase(note_id);
+                    continue;
+                }
+                auto card = it->second;
+                if (!card->get_note_mod()) {
+                    card->set_note_mod(mod);
+                }
+                if (card->get_note_mod() == mod) {
+                    changed.erase(note_id);
+                }
+            }
+            // Cached notes missing from the response were deleted
+            for (const auto &[note_id, mod] : cached) {
+                stale.push_back(note_id);
+                if (!loaded.contains(note_id)) {
+                    changed.erase(note_id);
+                }
+            }
+            anki.invalidate_notes(stale);
+            failing = false;
+            if (changed.empty()) {
+                continue;
+            }
+            // Notes missing from the response were deleted and get their ids reset
+            note_ids.assign(changed.begin(), changed.end());
+            anki.invalidate_notes(note_ids);
+            params = {{"notes", note_ids}};
+            const auto notes =
+                co_await anki.async_request(loop, "notesInfo", std::move(params));
+            for (size_t idx = 0; idx < notes.size() && idx < note_ids.size(); ++idx) {
+                auto card = loaded.at(note_ids[idx]);
+                // A local edit queued during the round trip is newer than Anki's state
+                if (card->get_sync_status() == Card::SyncStatus::Pending) {
+                    continue;
+                }
+                if (notes[idx].empty()) {
+                    card->set_note_id(0);
+                }
+                else if (apply_note_info(*card, notes[idx])) {
+                    anki_queue_update(*card);
+                }
+            }
+        }
+        catch (const std::exception &e) {
+            // Anki may be closed for a while, so only the first failure is logged
+            if (!failing) {
+                st::log::error("Can't poll Anki for changes: {}", e.what());
+            }
+            failing = true;
+        }
+    }
+}
+
+void CardModel::spawn(Task<void> task) const
+{
+    get_event_loop().spawn(std::move(task));
+}
+
 void CardModel::anki_update_card(const Card &card) const
 {
-    anki->request(
-        "updateNoteFields",
-        {
-            {"note",
-             {
-             {"id", card.get_note_id()},
-             {"fields",
-             {{"Front", card.get_front()},
-             {"Back", card.get_back()},
-             {"Forms", card.get_forms()},
-             {"PoS", card.get_pos_string()}}},
-             }}
-    });
+    get_anki().request("updateNoteFields", make_update_note_params(card));
+}
+
+void CardModel::anki_queue_add(Card &card, WriteBehindQueue::Callback flushed) const
+{
+    get_writer().push(card, WriteBehindQueue::Add, std::move(flushed));
+}
+
+void CardModel::anki_queue_update(Card &card) const
+{
+    get_writer().push(card, WriteBehindQueue::Update);
+}
+
+void CardModel::anki_write_batch(const std::vector<WriteBehindQueue::Item> &batch) const
+{
+    // Every card gets its write and a notesInfo reading it back, all in one request
+    auto actions = nlohmann::json::array();
+    std::vector<Card *> targets;
+    Card *browse_card{};
+    for (const auto &[card, operations, callbacks] : batch) {
+        if (operations & WriteBehindQueue::Add) {
+            browse_card = card;
+        }
+        if (card->get_note_id()) {
+            if (!(operations & WriteBehindQueue::Update)) {
+                card->set_sync_status(Card::SyncStatus::Committed);
+                continue;
+            }
+            actions.push_back(
+                make_action("updateNoteFields", make_update_note_params(*card)));
+        }
+        else if (operations & WriteBehindQueue::Add) {
+            actions.push_back(make_action("addNote", make_add_note_params(*card)));
+        }
+        else {
+            card->set_sync_status(Card::SyncStatus::Failed);
+            continue;
+        }
+        // An update is read back by its id, as other notes may have the same front
+        if (const auto note_id = card->get_note_id()) {
+            const std::vector<uint64_t> note_ids{note_id};
+            actions.push_back(make_action("notesInfo", {{"notes", note_ids}}));
+        }
+        else {
+            actions.push_back(
+                make_action("notesInfo", {{"query", front_query(card->get_front())}}));
+        }
+        targets.push_back(card);
+    }
+    if (browse_card) {
+        actions.push_back(
+            make_action("guiBrowse", {{"query", front_query(browse_card->get_front())}}));
+    }
+    if (actions.empty()) {
+        return;
+    }
+    const auto results = get_anki().request("multi", {{"actions", actions}});
+    for (size_t idx = 0; idx < targets.size(); ++idx) {
+        auto card = targets[idx];
+        const auto &notes = results.at(2 * idx + 1).at("result");
+        const bool is_update = actions[2 * idx].at("action") == "updateNoteFields";
+        // A duplicate error of addNote is fine as long as the note is there
+        if (!notes.is_array() || notes.empty() || notes.at(0).empty() ||
+            (is_update && !results.at(2 * idx).at("error").is_null())) {
+            card->set_sync_status(Card::SyncStatus::Failed);
+            continue;
+        }
+        apply_note_info(*card, notes.at(0));
+        card->set_sync_status(Card::SyncStatus::Committed);
+    }
+}
+
+nlohmann::json CardModel::anki_read_notes(
+    const AnkiCollection::Filter &filter, const std::string &query) const
+{
+    if (const auto collection = get_collection()) {
+        try {
+            return collection->notes_info(filter);
+        }
+        catch (const std::exception &) {
+            // Anki is running and holds the collection lock
+        }
+    }
+    return get_anki().notes_info(
+        get_anki().find_notes(query).get<std::vector<uint64_t>>());
 }
 
 bool CardModel::anki_find_card(Card &card) const
 {
-    auto notes = anki->request(
-        "findNotes",
-        {
-            {"query",
-             "\"deck:" + Config::get<std::string>("deck") + "\" front:\"" +
-             card.get_front() + "\""}
-    });
+    auto notes = get_anki().find_notes(front_query(card.get_front()));
     if (notes.empty()) {
         card.set_note_id(0);
         return false;
@@ -350,88 +1175,71 @@ bool CardModel::anki_find_card(Card &card) const
     return true;
 }
 
+std::vector<std::pair<std::string, uint64_t>> CardModel::anki_get_deck_fronts() const
+{
+    std::vector<std::pair<std::string, uint64_t>> result;
+    const auto deck = Config::get<std::string>("deck");
+    for (const auto &note : anki_read_notes({.deck = deck}, "\"deck:" + deck + "\"")) {
+        result.emplace_back(
+            tools::normalize_word(
+                note.at("fields").at("Front").at("value").get<std::string>()),
+            note.at("noteId").get<uint64_t>());
+    }
+    return result;
+}
+
 void CardModel::anki_fix_collection(bool commit) const
 {
-    for (const auto &note : anki->request(
-             "notesInfo",
-             {
-                 {"notes",
-                  anki->request(
-                  "findNotes", {{"query",
- "\"deck:" + Config::get<std::string>("deck") + "\""}})}
-    })) {
+    const auto deck = Config::get<std::string>("deck");
+    // All the fixes of a note go into one update, sent in batches at the end
+    std::vector<nlohmann::json> updates;
+    for (const auto &note : anki_read_notes({.deck = deck}, "\"deck:" + deck + "\"")) {
         const auto front_old =
             note.at("fields").at("Front").at("value").get<std::string>();
         const auto back_old = note.at("fields").at("Back").at("value").get<std::string>();
         const auto pos_old = note.at("fields").at("PoS").at("value").get<std::string>();
-        const auto note_id = note.at("noteId").get<uint64_t>();
+        auto fields = nlohmann::json::object();
         const auto front = tools::clear_string(front_old);
         if (front != front_old) {
             std::cout << "Fix front: " << front_old << " to: " << front << std::endl;
-            if (commit) {
-                anki->request(
-                    "updateNoteFields",
-                    {
-                        {"note",
-                         {
-                         {"id", note_id},
-                         {"fields",
-                         {
-                         {"Front", front},
-                         }},
-                         }}
-                });
-            }
+            fields["Front"] = front;
         }
         const auto back = tools::clear_string(back_old);
         if (back != back_old) {
             std::cout << "Fix back: " << back_old << " to: " << back << std::endl;
-            if (commit) {
-                anki->request(
-                    "updateNoteFields",
-                    {
-                        {"note",
-                         {
-                         {"id", note_id},
-                         {"fields",
-                         {
-                         {"Back", back},
-                         }},
-                         }}
-                });
-            }
+            fields["Back"] = back;
         }
         const auto s = tools::split<std::set>(tools::clear_string(pos_old), ", ");
         const auto pos = fmt::format("{}", fmt::join(s, ", "));
         if (pos != pos_old) {
             std::cout << "Fix pos: " << pos_old << " to: " << pos << std::endl;
-            if (commit) {
-                anki->request(
-                    "updateNoteFields",
-                    {
-                        {"note",
-                         {
-                         {"id", note_id},
-                         {"fields", {{"PoS", pos}}},
-                         }}
-                });
-            }
+            fields["PoS"] = pos;
+        }
+        if (!fields.empty()) {
+            updates.push_back(
+                {{"note", {{"id", note.at("noteId")}, {"fields", std::move(fields)}}}});
+        }
+    }
+    if (!commit || updates.empty()) {
+        return;
+    }
+    size_t failed = 0;
+    for (const auto &result : get_anki().bulk_request("updateNoteFields", updates)) {
+        if (!result.at("error").is_null()) {
+            ++failed;
         }
     }
+    if (failed) {
+        throw std::runtime_error(
+            fmt::format("AnkiConnect error: {} notes were not updated", failed));
+    }
 }
 
 void CardModel::anki_nvim_export(const char *filename) const
 {
-    auto notes = anki->request(
-        "findNotes",
-        {
-            {"query", "\"deck:Vocabulary Profile\" -is:new -is:learn -is:suspended"}
-    });
-    notes = anki->request(
-        "notesInfo",
-        {
-            {"notes", std::move(notes)}
-    });
+    const auto notes = anki_read_notes(
+        {.deck = "Vocabulary Profile", .cards = AnkiCollection::Cards::Reviewed},
+        "\"deck:Vocabulary Profile\" -is:new -is:learn -is:suspended");
 
     std::map<std::string, std::string> map;
     for (const auto &note : notes) {
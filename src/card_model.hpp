@@ -1,31 +1,96 @@
 #ifndef CARDMODEL_HPP
 #define CARDMODEL_HPP
 
-#include "card.hpp"
+#include "card_queue.hpp"
+#include "utility/anki_collection.hpp"
+#include "utility/pipeline.hpp"
+#include "utility/task.hpp"
+#include "write_behind_queue.hpp"
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 
-class SqliteDatabase;
+class SqlitePool;
 class SpeechEngine;
 class AnkiClient;
+class MappedFile;
+class Lemmatizer;
+class BkTree;
+class ProfileSnapshot;
+class SkippedList;
+class EventLoop;
+class AnkiTape;
+
+struct ProfileEntry
+{
+    std::string base;
+    std::string level;
+    std::string pos;
+    std::string gw;
+};
+
+/** The class owns the cards and the handles to the external services
 
+    The card queue and the cards synchronize themselves. The lazy handles are
+    created once under std::call_once. The databases are pooled with one
+    connection per thread, Anki requests are serialized by the client, and
+    speech and Safari are guarded by their own mutexes. Kindle and clippings
+    sources and the skipped list are owned by the thread that opened them.
+    Asynchronous tasks run on the event loop thread
+*/
 class CardModel
 {
 public:
+    /// Subsystems are initialized lazily on first use or up front by warm_up
+    enum Subsystem : uint8_t {
+        ProfileDb = 1 << 0,
+        ProfileIndex = 1 << 1,
+        Anki = 1 << 2,
+        Speech = 1 << 3,
+    };
+
     CardModel();
+    ~CardModel();
+
+    /// Initializes the given subsystems concurrently
+    void warm_up(uint8_t subsystems) const;
+    /// Must be set before the first Anki request
+    void set_anki_tape(std::shared_ptr<AnkiTape> tape);
 
     void open_kindle_db();
     std::vector<std::string> get_kindle_booklist() const;
-    void load_from_kindle(const std::string &book, size_t &current_card_idx);
+    void load_from_kindle(
+        const std::string &book, size_t &current_card_idx, bool full_rescan = false);
+    /// Advances the watermark over the lookups whose cards were reviewed
+    void save_kindle_watermark();
     void close_kindle_db();
 
+    void open_kindle_clippings();
+    std::vector<std::string> get_clippings_booklist() const;
+    void load_from_clippings(const std::string &book, size_t &current_card_idx);
+    void close_kindle_clippings();
+
     void load_suspended_cards();
     void load_leech_cards();
 
     size_t insert_new_card(std::string word, size_t idx);
+    /// The card insert_new_card would add for the word, not added to the model
+    std::unique_ptr<Card> make_new_card(std::string word) const;
+    /// Per-stage counters of the last import
+    std::vector<PipelineStageStats> get_import_stats() const;
 
     string_set_pair get_word_info(const std::string &word) const;
-    void query_vocabulary_profile(const std::string &query) const;
+    std::vector<ProfileEntry> find_in_vocabulary_profile(
+        const std::string &query, size_t max_distance = 0) const;
+    void query_vocabulary_profile(
+        const std::string &query, size_t max_distance = 0) const;
+    std::vector<std::string> suggest_words(const std::string &word, size_t count) const;
+    void build_profile_snapshot() const;
+
+    /// Words skipped during review, migrated from the state file on first use
+    SkippedList &get_skipped_list();
 
     Card &get_card(size_t idx);
     const Card &get_card(size_t idx) const;
@@ -35,23 +100,96 @@ public:
     void look_up_in_safari(const std::string &word);
     void say(const std::string &word) const;
 
-    void anki_add_card(Card &card) const;
+    /// Opens the added note in Anki's browser if asked
+    void anki_add_card(Card &card, bool browse = true) const;
     void anki_open_browser(const Card &card) const;
     void anki_reload_card(Card &card) const;
     void anki_update_card(const Card &card) const;
 
+    /// Run on the event loop started by spawn(), so the caller isn't blocked
+    Task<void> anki_open_browser_async(std::string front) const;
+    Task<void> anki_reload_card_async(Card &card) const;
+    /// Periodically reloads the loaded cards whose notes were modified in Anki,
+    /// and drops the client's cached responses for those notes
+    Task<void> anki_watch_changes() const;
+    void spawn(Task<void> task) const;
+
+    /// Queue the write for the background writer, which sets the card sync status
+    /// The callback runs on the writer thread once the add is committed or failed
+    void anki_queue_add(Card &card, WriteBehindQueue::Callback flushed = {}) const;
+    void anki_queue_update(Card &card) const;
+
     bool anki_find_card(Card &card) const;
+    std::vector<std::pair<std::string, uint64_t>> anki_get_deck_fronts() const;
 
     void anki_fix_collection(bool commit) const;
     void anki_nvim_export(const char *filename) const;
 
 private:
-    std::vector<std::unique_ptr<Card>> cards;
-    std::shared_ptr<SqliteDatabase> kindle_db;
-    std::shared_ptr<SqliteDatabase> vocabulary_profile_db;
-    std::shared_ptr<SpeechEngine> speech;
-    std::shared_ptr<AnkiClient> anki;
+    using CardPipeline = Pipeline<std::unique_ptr<Card>>;
+    using WordSource = std::function<void(const std::function<void(std::string)> &)>;
+
+    std::vector<ProfileEntry> find_in_vocabulary_profile_fuzzy(
+        const std::string &query, size_t max_distance) const;
+    std::vector<ProfileEntry> find_profile_rows(const std::string &base) const;
+    std::vector<std::string> get_profile_bases() const;
+    uint64_t get_profile_stamp() const;
+    const ProfileSnapshot *get_profile_snapshot() const;
+    SqlitePool &get_profile_db() const;
+    AnkiClient &get_anki() const;
+    SpeechEngine *get_speech() const;
+    const Lemmatizer &get_lemmatizer() const;
+    WriteBehindQueue &get_writer() const;
+    EventLoop &get_event_loop() const;
+    void anki_write_batch(const std::vector<WriteBehindQueue::Item> &batch) const;
+    const BkTree &get_bk_tree() const;
+    const AnkiCollection *get_collection() const;
+    /// Reads notes from the collection file if possible, through AnkiConnect otherwise
+    nlohmann::json anki_read_notes(
+        const AnkiCollection::Filter &filter, const std::string &query) const;
+    void load_notes(const nlohmann::json &notes);
+    /// Runs the words through normalize, dedup, Anki check and enrich stages
+    bool load_words(
+        const WordSource &source, const std::string &tag, size_t &current_card_idx);
+    static bool normalize_card(Card &card);
+    void enrich_card(Card &card) const;
+
+private:
+    CardQueue cards;
+    std::unique_ptr<SqlitePool> kindle_db;
+    std::unique_ptr<MappedFile> clippings_file;
+    mutable std::unique_ptr<SqlitePool> vocabulary_profile_db;
+    mutable std::unique_ptr<ProfileSnapshot> profile_snapshot;
+    mutable std::unique_ptr<Lemmatizer> lemmatizer;
+    mutable std::unique_ptr<BkTree> bk_tree;
+    mutable std::unique_ptr<AnkiCollection> collection;
+    std::unique_ptr<SkippedList> skipped_list;
+    mutable std::shared_ptr<SpeechEngine> speech;
+    mutable std::shared_ptr<AnkiClient> anki;
+    std::shared_ptr<AnkiTape> anki_tape;
+    mutable std::once_flag vocabulary_profile_db_flag;
+    mutable std::once_flag profile_snapshot_flag;
+    mutable std::once_flag lemmatizer_flag;
+    mutable std::once_flag bk_tree_flag;
+    mutable std::once_flag collection_flag;
+    std::once_flag skipped_list_flag;
+    mutable std::once_flag speech_flag;
+    mutable std::once_flag anki_flag;
+    mutable std::once_flag event_loop_flag;
+    mutable std::mutex speech_mutex;
+    std::mutex safari_mutex;
     std::string last_safari_word;
+    std::string kindle_device_id;
+    std::string kindle_watermark_key;
+    // The first lookup of every loaded Kindle word by its normalized front
+    std::unordered_map<std::string, int64_t> kindle_first_lookups;
+    int64_t kindle_last_lookup = 0;
+    std::vector<PipelineStageStats> import_stats;
+    mutable std::unique_ptr<EventLoop> event_loop;
+    mutable std::thread event_loop_thread;
+    // Declared last, so queued writes are flushed while the handles are alive
+    mutable std::unique_ptr<WriteBehindQueue> writer;
+    mutable std::once_flag writer_flag;
 };
 
 
@@ -0,0 +1,53 @@
+#include "card_queue.hpp"
+#include <mutex>
+#include <stdexcept>
+
+Card &CardQueue::at(size_t idx) const
+{
+    std::shared_lock lock(mutex);
+    return *cards.at(idx);
+}
+
+size_t CardQueue::size() const
+{
+    std::shared_lock lock(mutex);
+    return cards.size();
+}
+
+bool CardQueue::empty() const
+{
+    std::shared_lock lock(mutex);
+    return cards.empty();
+}
+
+size_t CardQueue::append(std::vector<std::unique_ptr<Card>> new_cards)
+{
+    std::unique_lock lock(mutex);
+    const auto first = cards.size();
+    cards.reserve(first + new_cards.size());
+    for (auto &card : new_cards) {
+        cards.push_back(std::move(card));
+    }
+    return first;
+}
+
+size_t CardQueue::insert(size_t idx, std::unique_ptr<Card> card)
+{
+    std::unique_lock lock(mutex);
+    if (idx > cards.size()) {
+        throw std::out_of_range("CardQueue::insert");
+    }
+    cards.insert(cards.begin() + idx, std::move(card));
+    return idx;
+}
+
+std::optional<size_t> CardQueue::find(const std::string &front) const
+{
+    std::shared_lock lock(mutex);
+    for (size_t idx = 0; idx < cards.size(); ++idx) {
+        if (cards[idx]->get_front() == front) {
+            return idx;
+        }
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,35 @@
+#ifndef CARD_QUEUE_HPP
+#define CARD_QUEUE_HPP
+
+#include "card.hpp"
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <vector>
+
+/** The class represents the list of cards shared by producers and the UI
+
+    Cards are heap allocated and never removed, so a reference returned by
+    at() stays valid while other threads append. Appending keeps the indices
+    of existing cards; only insert() shifts the cards after the position.
+    Card contents are refreshed in place through the card's own lock
+*/
+class CardQueue
+{
+public:
+    Card &at(size_t idx) const;
+    size_t size() const;
+    bool empty() const;
+
+    /// Returns the index of the first appended card
+    size_t append(std::vector<std::unique_ptr<Card>> new_cards);
+    size_t insert(size_t idx, std::unique_ptr<Card> card);
+
+    std::optional<size_t> find(const std::string &front) const;
+
+private:
+    mutable std::shared_mutex mutex;
+    std::vector<std::unique_ptr<Card>> cards;
+};
+
+#endif // CARD_QUEUE_HPP
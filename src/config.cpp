@@ -23,6 +23,13 @@ Config::Config() :
         json["deck"] = "Vocabulary Profile";
         json["card_model"] = "Main en-GB";
         json["cambridge_dictionary"] = "english-russian";
+        json["kindle_mount_path"] = "/Volumes/Kindle";
+        json["navigation_debounce_ms"] = 150;
+        json["anki_poll_interval_ms"] = 5000;
+        json["anki_batch_min_size"] = 10;
+        json["anki_batch_max_size"] = 1000;
+        json["anki_batch_target_ms"] = 250;
+        json["anki_collection_path"] = "";
     }
     if (auto conf = get_state_filepath(); std::filesystem::exists(conf)) {
         std::ifstream(conf) >> json_state;
@@ -42,6 +49,7 @@ void Config::set_sound_enabled(bool value)
 Config::~Config()
 {
     try {
+        std::lock_guard lock(mutex);
         std::ofstream(get_config_filepath()) << std::setw(4) << json;
         std::ofstream(get_state_filepath()) << std::setw(4) << json_state;
     }
@@ -66,9 +74,43 @@ std::string Config::get_vocabulary_profile_filepath() const
     return get_app_path().append("vocabulary_profile.db");
 }
 
+std::string Config::get_fuzzy_index_filepath() const
+{
+    return get_app_path().append("vocabulary_profile.bktree");
+}
+
+std::string Config::get_profile_snapshot_filepath() const
+{
+    return get_app_path().append("vocabulary_profile.snapshot");
+}
+
+std::string Config::get_kindle_mount_path() const
+{
+    std::lock_guard lock(mutex);
+    return json.value("kindle_mount_path", "/Volumes/Kindle");
+}
+
 std::string Config::get_kindle_db_filepath() const
 {
-    return "/Volumes/Kindle/system/vocabulary/vocab.db";
+    return std::filesystem::path(get_kindle_mount_path())
+        .append("system/vocabulary/vocab.db");
+}
+
+std::string Config::get_kindle_db_copy_filepath(const std::string &device_id) const
+{
+    return get_app_path().append("kindle_vocab_" + device_id + ".db");
+}
+
+std::string Config::get_kindle_clippings_filepath() const
+{
+    return std::filesystem::path(get_kindle_mount_path())
+        .append("documents/My Clippings.txt");
+}
+
+std::string Config::get_anki_collection_filepath() const
+{
+    std::lock_guard lock(mutex);
+    return json.value("anki_collection_path", "");
 }
 
 std::string Config::get_config_filepath() const
@@ -80,3 +122,42 @@ std::string Config::get_state_filepath() const
 {
     return get_app_path().append("vocabulary_builder_state.json");
 }
+
+std::string Config::get_latency_filepath() const
+{
+    return get_app_path().append("vocabulary_builder_latency.tsv");
+}
+
+std::string Config::get_skipped_list_filepath() const
+{
+    return get_app_path().append("vocabulary_builder_skipped.sst");
+}
+
+std::string Config::get_daemon_socket_filepath() const
+{
+    return get_app_path().append("vocabulary_builder.sock");
+}
+
+std::chrono::milliseconds Config::get_navigation_debounce() const
+{
+    std::lock_guard lock(mutex);
+    return std::chrono::milliseconds(json.value("navigation_debounce_ms", 150));
+}
+
+std::chrono::milliseconds Config::get_anki_poll_interval() const
+{
+    std::lock_guard lock(mutex);
+    return std::chrono::milliseconds(json.value("anki_poll_interval_ms", 5000));
+}
+
+BatchController::Limits Config::get_anki_batch_limits() const
+{
+    std::lock_guard lock(mutex);
+    BatchController::Limits limits;
+    limits.min_size = std::max<size_t>(json.value("anki_batch_min_size", 10), 1);
+    limits.max_size =
+        std::max<size_t>(json.value("anki_batch_max_size", 1000), limits.min_size);
+    limits.target_latency =
+        std::chrono::milliseconds(json.value("anki_batch_target_ms", 250));
+    return limits;
+}
@@ -2,8 +2,11 @@
 #define CONFIG_HPP
 
 
+#include "utility/batch_controller.hpp"
+#include <chrono>
 #include <filesystem>
 #include <libs/json.hpp>
+#include <mutex>
 
 class Config
 {
@@ -17,6 +20,7 @@ public:
     template<typename T>
     static T get(const std::string &key)
     {
+        std::lock_guard lock(instance().mutex);
         auto &value = instance().json[key];
         if (value.is_null()) {
             value = T{};
@@ -27,6 +31,7 @@ public:
     template<typename T>
     static T get(const std::string &key, const std::string &inner_key)
     {
+        std::lock_guard lock(instance().mutex);
         auto &value = instance().json[key][inner_key];
         if (value.is_null()) {
             value = T{};
@@ -37,18 +42,21 @@ public:
     template<typename T>
     static void set(const std::string &key, T &&value)
     {
+        std::lock_guard lock(instance().mutex);
         instance().json[key] = std::forward<T>(value);
     }
 
     template<typename T>
     static void set(const std::string &key, const std::string &inner_key, T &&value)
     {
+        std::lock_guard lock(instance().mutex);
         instance().json[key][inner_key] = std::forward<T>(value);
     }
 
     template<typename T>
     static T get_state(const std::string &key)
     {
+        std::lock_guard lock(instance().mutex);
         auto &value = instance().json_state[key];
         if (value.is_null()) {
             value = T{};
@@ -59,6 +67,7 @@ public:
     template<typename T>
     static T get_state(const std::string &key, const std::string &inner_key)
     {
+        std::lock_guard lock(instance().mutex);
         auto &value = instance().json_state[key][inner_key];
         if (value.is_null()) {
             value = T{};
@@ -69,21 +78,41 @@ public:
     template<typename T>
     static void set_state(const std::string &key, T &&value)
     {
+        std::lock_guard lock(instance().mutex);
         instance().json_state[key] = std::forward<T>(value);
     }
 
     template<typename T>
     static void set_state(const std::string &key, const std::string &inner_key, T &&value)
     {
+        std::lock_guard lock(instance().mutex);
         instance().json_state[key][inner_key] = std::forward<T>(value);
     }
 
+    static void erase_state(const std::string &key)
+    {
+        std::lock_guard lock(instance().mutex);
+        instance().json_state.erase(key);
+    }
+
     std::filesystem::path get_app_path() const;
 
     std::string get_vocabulary_profile_filepath() const;
+    std::string get_fuzzy_index_filepath() const;
+    std::string get_profile_snapshot_filepath() const;
+    std::string get_kindle_mount_path() const;
     std::string get_kindle_db_filepath() const;
+    std::string get_kindle_db_copy_filepath(const std::string &device_id) const;
+    std::string get_kindle_clippings_filepath() const;
+    std::string get_anki_collection_filepath() const;
     std::string get_config_filepath() const;
     std::string get_state_filepath() const;
+    std::string get_skipped_list_filepath() const;
+    std::string get_latency_filepath() const;
+    std::string get_daemon_socket_filepath() const;
+    std::chrono::milliseconds get_navigation_debounce() const;
+    std::chrono::milliseconds get_anki_poll_interval() const;
+    BatchController::Limits get_anki_batch_limits() const;
 
     bool is_sound_enabled() const;
     void set_sound_enabled(bool value);
@@ -92,6 +121,8 @@ private:
     Config();
     std::filesystem::path app_path;
     bool sound_enabled = false;
+    /// Guards both documents, settings and state are read from worker threads too
+    mutable std::mutex mutex;
     nlohmann::json json;
     nlohmann::json json_state;
 };
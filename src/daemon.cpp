@@ -0,0 +1,321 @@
+#include "daemon.hpp"
+#include "card_model.hpp"
+#include "config.hpp"
+#include "utility/tools.hpp"
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <st/assert_or_throw.hpp>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Requests or responses queued for a single client beyond this drop the client
+constexpr size_t max_client_buffer = 1 << 20;
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void request_stop(int)
+{
+    stop_requested = 1;
+}
+
+static sockaddr_un make_address(const std::string &socket_path)
+{
+    sockaddr_un address{};
+    st::assert_or_throw(
+        socket_path.size() < sizeof(address.sun_path), "Socket path is too long: {}",
+        socket_path);
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return address;
+}
+
+static int connect_to(const std::string &socket_path)
+{
+    const auto address = make_address(socket_path);
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    st::assert_or_throw(fd >= 0, "Can't create a socket: {}", std::strerror(errno));
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) !=
+        0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void write_all(int fd, std::string_view data)
+{
+    while (!data.empty()) {
+        const auto size = ::write(fd, data.data(), data.size());
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::strerror(errno));
+        }
+        data.remove_prefix(size);
+    }
+}
+
+/// Writes as much as the socket takes, returns false if the client is gone
+static bool write_some(int fd, std::string &data)
+{
+    size_t written = 0;
+    while (written < data.size()) {
+        const auto size = ::write(fd, data.data() + written, data.size() - written);
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return false;
+            }
+            break;
+        }
+        written += size;
+    }
+    data.erase(0, written);
+    return true;
+}
+
+Daemon::Daemon(std::shared_ptr<CardModel> model, std::string socket_path) :
+    model(std::move(model)),
+    socket_path(std::move(socket_path))
+{
+    if (const int fd = connect_to(this->socket_path); fd >= 0) {
+        ::close(fd);
+        throw std::runtime_error("The daemon is already running");
+    }
+    ::unlink(this->socket_path.c_str());
+    const auto address = make_address(this->socket_path);
+    listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    st::assert_or_throw(
+        listen_fd >= 0, "Can't create a socket: {}", std::strerror(errno));
+    const auto addr = reinterpret_cast<const sockaddr *>(&address);
+    if (::bind(listen_fd, addr, sizeof(address)) != 0 ||
+        ::listen(listen_fd, SOMAXCONN) != 0) {
+        ::close(listen_fd);
+        throw std::runtime_error(
+            "Can't listen on " + this->socket_path + ": " + std::strerror(errno));
+    }
+    load_deck();
+}
+
+Daemon::~Daemon()
+{
+    ::close(listen_fd);
+    ::unlink(socket_path.c_str());
+}
+
+void Daemon::run()
+{
+    struct sigaction action{};
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    struct Client
+    {
+        std::string input;
+        std::string output;
+    };
+
+    std::vector<pollfd> fds{
+        {listen_fd, POLLIN, 0}
+    };
+    std::vector<Client> clients{{}};
+    char chunk[4096];
+    while (!stop_requested) {
+        for (size_t idx = 1; idx < fds.size(); ++idx) {
+            fds[idx].events = clients[idx].output.empty() ? POLLIN : POLLIN | POLLOUT;
+        }
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::strerror(errno));
+        }
+        for (size_t idx = fds.size(); idx-- > 1;) {
+            const auto revents = fds[idx].revents;
+            if (!revents) {
+                continue;
+            }
+            auto &client = clients[idx];
+            bool connected = true;
+            if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                const auto size = ::read(fds[idx].fd, chunk, sizeof(chunk));
+                if (size > 0) {
+                    client.input.append(chunk, size);
+                    process_input(client.input, client.output);
+                }
+                else if (size == 0 || (errno != EAGAIN && errno != EINTR)) {
+                    connected = false;
+                }
+            }
+            // A client that doesn't read its responses must not stall the others
+            if (connected) {
+                connected = write_some(fds[idx].fd, client.output) &&
+                            client.input.size() <= max_client_buffer &&
+                            client.output.size() <= max_client_buffer;
+            }
+            if (!connected) {
+                ::close(fds[idx].fd);
+                fds.erase(fds.begin() + idx);
+                clients.erase(clients.begin() + idx);
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            if (const int fd = ::accept(listen_fd, nullptr, nullptr); fd >= 0) {
+                ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+                fds.push_back({fd, POLLIN, 0});
+                clients.emplace_back();
+            }
+        }
+    }
+    for (size_t idx = 1; idx < fds.size(); ++idx) {
+        ::close(fds[idx].fd);
+    }
+}
+
+void Daemon::process_input(std::string &input, std::string &output)
+{
+    size_t start = 0;
+    for (size_t end; (end = input.find('\n', start)) != std::string::npos;
+         start = end + 1) {
+        nlohmann::json response;
+        try {
+            response = process_request(
+                nlohmann::json::parse(input.begin() + start, input.begin() + end));
+        }
+        catch (const std::exception &e) {
+            response = {
+                {"result",  nullptr},
+                { "error", e.what()}
+            };
+        }
+        output += response.dump();
+        output += '\n';
+    }
+    input.erase(0, start);
+}
+
+void Daemon::run_client(const std::string &socket_path)
+{
+    const int fd = connect_to(socket_path);
+    st::assert_or_throw(fd >= 0, "The daemon is not running on {}", socket_path);
+    std::string response;
+    char chunk[4096];
+    for (std::string line; std::getline(std::cin, line);) {
+        if (line.empty()) {
+            continue;
+        }
+        write_all(fd, line.append(1, '\n'));
+        size_t pos;
+        while ((pos = response.find('\n')) == std::string::npos) {
+            const auto size = ::read(fd, chunk, sizeof(chunk));
+            if (size <= 0) {
+                ::close(fd);
+                throw std::runtime_error("The daemon closed the connection");
+            }
+            response.append(chunk, size);
+        }
+        std::cout.write(response.data(), pos + 1).flush();
+        response.erase(0, pos + 1);
+    }
+    ::close(fd);
+}
+
+nlohmann::json Daemon::process_request(const nlohmann::json &request)
+{
+    const auto cmd = request.at("cmd").get<std::string>();
+    const auto word = tools::normalize_word(request.at("word").get<std::string>());
+    nlohmann::json result;
+    if (cmd == "query") {
+        result = nlohmann::json::array();
+        for (const auto &entry :
+             model->find_in_vocabulary_profile(word, request.value<size_t>("fuzzy", 0))) {
+            result.push_back({
+                {"base", entry.base},
+                {"level", entry.level},
+                {"pos", entry.pos},
+                {"gw", entry.gw},
+            });
+        }
+    }
+    else if (cmd == "word_info") {
+        const auto pair = model->get_word_info(word);
+        result = {
+            {"levels", pair.first},
+            {   "pos", pair.second}
+        };
+    }
+    else if (cmd == "exists") {
+        result = find_note(word);
+    }
+    else if (cmd == "add") {
+        // The card isn't kept by the model, the mirror remembers the note
+        const auto card = model->make_new_card(word);
+        const auto front = card->get_front();
+        auto note_id = find_note(front);
+        if (!note_id) {
+            model->anki_add_card(*card, false);
+            note_id = card->get_note_id();
+            deck[front] = {
+                note_id,
+                std::chrono::steady_clock::now() +
+                    Config::instance().get_anki_poll_interval()};
+            missing.erase(front);
+            missing.erase(word);
+        }
+        result = note_id;
+    }
+    else {
+        throw std::runtime_error("Unknown command: " + cmd);
+    }
+    return {
+        {"result", std::move(result)},
+        { "error",           nullptr}
+    };
+}
+
+uint64_t Daemon::find_note(const std::string &word)
+{
+    // A note may be added, renamed or deleted in Anki at any time, so hits and
+    // misses are both trusted for one poll interval only. Most lookups are of
+    // words not in the deck
+    const auto now = std::chrono::steady_clock::now();
+    const auto interval = Config::instance().get_anki_poll_interval();
+    if (auto it = deck.find(word); it != deck.end() && now < it->second.expiry) {
+        return it->second.note_id;
+    }
+    if (now >= missing_expiry) {
+        missing.clear();
+        missing_expiry = now + interval;
+    }
+    if (missing.contains(word)) {
+        return 0;
+    }
+    Card card;
+    card.set_front(word);
+    if (model->anki_find_card(card)) {
+        deck[word] = {card.get_note_id(), now + interval};
+    }
+    else {
+        deck.erase(word);
+        missing.insert(word);
+    }
+    return card.get_note_id();
+}
+
+void Daemon::load_deck()
+{
+    const auto expiry =
+        std::chrono::steady_clock::now() + Config::instance().get_anki_poll_interval();
+    for (auto &[front, note_id] : model->anki_get_deck_fronts()) {
+        deck.emplace(std::move(front), DeckEntry{note_id, expiry});
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef DAEMON_HPP
+#define DAEMON_HPP
+
+#include <chrono>
+#include <libs/json.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+
+class CardModel;
+
+/** Serves vocabulary lookups over a Unix domain socket
+
+    Every request and response is a single line of JSON. A request names the
+    command and its arguments: {"cmd": "query", "word": "run", "fuzzy": 1}.
+    Supported commands are query, word_info, exists and add. Responses follow
+    AnkiConnect: {"result": ..., "error": null}
+*/
+class Daemon
+{
+public:
+    Daemon(std::shared_ptr<CardModel> model, std::string socket_path);
+    ~Daemon();
+    Daemon(const Daemon &) = delete;
+    Daemon &operator=(const Daemon &) = delete;
+
+    void run();
+
+    /// Forwards request lines from stdin to the daemon and prints the responses
+    static void run_client(const std::string &socket_path);
+
+private:
+    /// Answers every complete request line in input, appending to output
+    void process_input(std::string &input, std::string &output);
+    nlohmann::json process_request(const nlohmann::json &request);
+    uint64_t find_note(const std::string &word);
+    void load_deck();
+
+private:
+    std::shared_ptr<CardModel> model;
+    std::string socket_path;
+    int listen_fd = -1;
+    struct DeckEntry
+    {
+        uint64_t note_id;
+        std::chrono::steady_clock::time_point expiry;
+    };
+
+    // Notes found in the deck, trusted until their expiry
+    std::unordered_map<std::string, DeckEntry> deck;
+    // Words not in the deck, until the next poll interval
+    std::unordered_set<std::string> missing;
+    std::chrono::steady_clock::time_point missing_expiry;
+};
+
+#endif // DAEMON_HPP
@@ -1,6 +1,13 @@
 #include "app.hpp"
 #include "card_model.hpp"
 #include "config.hpp"
+#include "daemon.hpp"
+#include "utility/curl_request.hpp"
+#include "utility/anki_tape.hpp"
+#include "utility/memory_stats.hpp"
+#include <charconv>
+#include <chrono>
+#include <cmath>
 #include <st/logger.hpp>
 
 inline constexpr auto APP_HELP =
@@ -13,29 +20,137 @@ Options:
   -h --help                     Show this help message and exit
   -v --version                  Display version information and exit
   -k --kindle                   Import cards from Kindle
+  --full                        Rescan the whole Kindle lookup history
+  -c --clippings                Import cards from Kindle "My Clippings.txt"
   -l --leech                    Work with leech cards
   -s --sound                    Read aloud current card
   --query <word>                Query vocabulary profile
+  --fuzzy <n>                   Query allowing up to <n> typos
+  --build-profile-snapshot      Compile the vocabulary profile for fast startup
   --suspended                   Work with suspended cards
   --check-collection            Check whole collection
   --fix-collection              Fix whole collection
   --nvim-export                 Export to ~/.config/nvim/dictionary.json
   --nvim-export <file>          Export to <file>
+  --daemon                      Serve lookups on ~/.keybr/vocabulary_builder.sock
+  --client                      Send JSON requests from stdin to the daemon
+  --timings                     Report startup time, redraws, import stages and latencies
+  --record <file>               Record AnkiConnect traffic to <file>
+  --replay <file>               Serve AnkiConnect responses recorded in <file>
+  --replay-speed <n>            Replay latencies <n> times faster, 0 for none
+  --mem-stats                   Report allocations per subsystem on exit
 )";
 
 using namespace st;
 
+/** Measures the time from start to the first output of the selected mode
+
+    The time the user spends in a modal is not counted. Batch modes have no
+    budget and report the time of their whole run
+*/
+class StartupTimer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr auto budget = std::chrono::milliseconds(150);
+
+    void pause()
+    {
+        paused_at = Clock::now();
+    }
+
+    void resume()
+    {
+        paused += Clock::now() - paused_at;
+    }
+
+    void stop(const char *mode_name, bool is_batch = false)
+    {
+        if (!mode) {
+            mode = mode_name;
+            batch = is_batch;
+            elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                Clock::now() - start - paused);
+        }
+    }
+
+    void report(bool verbose) const
+    {
+        const bool over_budget = !batch && elapsed > budget;
+        if (mode && (verbose || over_budget)) {
+            fmt::print(
+                stderr, "Time to {} in {} mode: {} ms{}\n",
+                batch ? "finish" : "first output", mode, elapsed.count(),
+                over_budget ? " (over budget)" : "");
+        }
+    }
+
+private:
+    const Clock::time_point start = Clock::now();
+    Clock::time_point paused_at;
+    Clock::duration paused{};
+    const char *mode{};
+    bool batch = false;
+    std::chrono::milliseconds elapsed{};
+};
+
+/// Reports the heap usage per subsystem when main returns, whatever the mode
+class MemoryReport
+{
+public:
+    bool enabled = false;
+
+    ~MemoryReport()
+    {
+        if (!enabled) {
+            return;
+        }
+        if (!MemoryStats::is_enabled()) {
+            fmt::print(stderr, "Only VB_MEMORY_STATS builds count allocations\n");
+            return;
+        }
+        constexpr auto tag_count = static_cast<uint8_t>(MemoryStats::Tag::Count);
+        for (uint8_t idx = 0; idx < tag_count; ++idx) {
+            const auto tag = static_cast<MemoryStats::Tag>(idx);
+            print(MemoryStats::to_string(tag), MemoryStats::get(tag));
+        }
+        print("all", MemoryStats::get_total());
+    }
+
+private:
+    static void print(const char *name, const MemoryStats::Counters &counters)
+    {
+        fmt::print(
+            stderr, "Memory of {}: {} allocations, {} KiB, {} KiB live, {} KiB peak\n",
+            name, counters.allocations, counters.bytes / 1024, counters.live / 1024,
+            counters.peak / 1024);
+    }
+};
+
 auto main(int argc, char *argv[]) -> int
 {
+    MemoryReport memory_report;
+    StartupTimer startup_timer;
+    bool timings{};
     try {
         bool kindle{};
+        bool full_rescan{};
+        bool clippings{};
         bool leech{};
         bool sound{};
         const char *query_word{};
+        size_t max_distance{};
+        bool build_profile_snapshot{};
         bool suspended{};
         bool check_collection{};
         bool fix_collection{};
         const char *nvim_export_filename{};
+        bool daemon{};
+        bool client{};
+        const char *record_filename{};
+        const char *replay_filename{};
+        double replay_speed = 1;
 
         for (auto it = argv + 1, end = argv + argc; it != end; ++it) {
             std::string_view arg{*it};
@@ -51,6 +166,14 @@ auto main(int argc, char *argv[]) -> int
                 kindle = true;
                 continue;
             }
+            if (arg == "--full") {
+                full_rescan = true;
+                continue;
+            }
+            if (arg == "-c" || arg == "--clippings") {
+                clippings = true;
+                continue;
+            }
             if (arg == "-l" || arg == "--leech") {
                 leech = true;
                 continue;
@@ -67,6 +190,22 @@ auto main(int argc, char *argv[]) -> int
                 query_word = *++it;
                 continue;
             }
+            if (arg == "--fuzzy") {
+                const std::string_view value{it + 1 == end ? "" : *(it + 1)};
+                const auto value_end = value.data() + value.size();
+                const auto [ptr, ec] =
+                    std::from_chars(value.data(), value_end, max_distance);
+                if (value.empty() || ec != std::errc{} || ptr != value_end) {
+                    fmt::print("{} requires a number of typos\n{}", arg, APP_HELP);
+                    return 1;
+                }
+                ++it;
+                continue;
+            }
+            if (arg == "--build-profile-snapshot") {
+                build_profile_snapshot = true;
+                continue;
+            }
             if (arg == "--suspended") {
                 suspended = true;
                 continue;
@@ -88,31 +227,118 @@ auto main(int argc, char *argv[]) -> int
                 }
                 continue;
             }
+            if (arg == "--timings") {
+                timings = true;
+                continue;
+            }
+            if (arg == "--record") {
+                if (it + 1 == end) {
+                    fmt::print("{} requires an argument\n{}", arg, APP_HELP);
+                    return 1;
+                }
+                record_filename = *++it;
+                continue;
+            }
+            if (arg == "--replay") {
+                if (it + 1 == end) {
+                    fmt::print("{} requires an argument\n{}", arg, APP_HELP);
+                    return 1;
+                }
+                replay_filename = *++it;
+                continue;
+            }
+            if (arg == "--replay-speed") {
+                const std::string_view value{it + 1 == end ? "" : *(it + 1)};
+                const auto value_end = value.data() + value.size();
+                const auto [ptr, ec] =
+                    std::from_chars(value.data(), value_end, replay_speed);
+                if (value.empty() || ec != std::errc{} || ptr != value_end ||
+                    !std::isfinite(replay_speed) || replay_speed < 0) {
+                    fmt::print("{} requires a non-negative number\n{}", arg, APP_HELP);
+                    return 1;
+                }
+                ++it;
+                continue;
+            }
+            if (arg == "--mem-stats") {
+                memory_report.enabled = true;
+                continue;
+            }
+            if (arg == "--daemon") {
+                daemon = true;
+                continue;
+            }
+            if (arg == "--client") {
+                client = true;
+                continue;
+            }
             fmt::print("Unexpected argument: {}\n{}", arg, APP_HELP);
             return 1;
         }
 
+        if (client) {
+            Daemon::run_client(Config::instance().get_daemon_socket_filepath());
+            return 0;
+        }
+
         Config::instance().set_sound_enabled(sound);
+        // The warm-up creates the sessions concurrently
+        CurlSession::init_global();
 
         auto model = std::make_shared<CardModel>();
+        if (replay_filename) {
+            model->set_anki_tape(std::make_shared<AnkiTape>(
+                replay_filename, AnkiTape::Mode::Replay, replay_speed));
+        }
+        else if (record_filename) {
+            model->set_anki_tape(
+                std::make_shared<AnkiTape>(record_filename, AnkiTape::Mode::Record));
+        }
 
+        if (daemon) {
+            model->warm_up(
+                CardModel::ProfileDb | CardModel::ProfileIndex | CardModel::Anki);
+            Daemon server(model, Config::instance().get_daemon_socket_filepath());
+            model->spawn(model->anki_watch_changes());
+            startup_timer.stop("daemon");
+            startup_timer.report(timings);
+            server.run();
+            return 0;
+        }
+
+        if (build_profile_snapshot) {
+            model->build_profile_snapshot();
+            startup_timer.stop("build snapshot", true);
+            startup_timer.report(timings);
+            return 0;
+        }
         if (check_collection) {
             model->anki_fix_collection(false);
+            startup_timer.stop("check", true);
+            startup_timer.report(timings);
             return 0;
         }
         if (fix_collection) {
             model->anki_fix_collection(true);
+            startup_timer.stop("fix", true);
+            startup_timer.report(timings);
             return 0;
         }
         if (nvim_export_filename) {
             model->anki_nvim_export(nvim_export_filename);
+            startup_timer.stop("export", true);
+            startup_timer.report(timings);
             return 0;
         }
         if (query_word) {
-            model->query_vocabulary_profile(query_word);
+            model->query_vocabulary_profile(query_word, max_distance);
+            startup_timer.stop("query");
+            startup_timer.report(timings);
             return 0;
         }
 
+        model->warm_up(CardModel::ProfileDb | CardModel::Anki | CardModel::Speech);
+
         auto screen = std::make_shared<Screen>();
         screen->init_color(ColorScheme::Window, COLOR_BLACK, COLOR_WHITE);
         screen->init_color(ColorScheme::Error, COLOR_RED, COLOR_TRANSPARRENT);
@@ -134,14 +360,39 @@ auto main(int argc, char *argv[]) -> int
                 }
             }
             auto menu = screen->create<VerticalListMenu>(std::move(booklist), item_idx);
+            startup_timer.pause();
             menu->run_modal();
+            startup_timer.resume();
             if (menu->is_cancelled()) {
                 throw std::runtime_error("You must select a book first");
             }
-            model->load_from_kindle(menu->get_item_string(), current_card_idx);
+            model->load_from_kindle(
+                menu->get_item_string(), current_card_idx, full_rescan);
             model->close_kindle_db();
             Config::set_state("kindle_book", menu->get_item_string());
         }
+        else if (clippings) {
+            size_t item_idx = 0;
+            model->open_kindle_clippings();
+            auto booklist = model->get_clippings_booklist();
+            if (auto last_book = Config::get_state<std::string>("clippings_book");
+                !last_book.empty()) {
+                auto it = std::find(booklist.begin(), booklist.end(), last_book);
+                if (it != booklist.end()) {
+                    item_idx = std::distance(booklist.begin(), it);
+                }
+            }
+            auto menu = screen->create<VerticalListMenu>(std::move(booklist), item_idx);
+            startup_timer.pause();
+            menu->run_modal();
+            startup_timer.resume();
+            if (menu->is_cancelled()) {
+                throw std::runtime_error("You must select a book first");
+            }
+            model->load_from_clippings(menu->get_item_string(), current_card_idx);
+            model->close_kindle_clippings();
+            Config::set_state("clippings_book", menu->get_item_string());
+        }
         else if (leech) {
             model->load_leech_cards();
         }
@@ -152,7 +403,9 @@ auto main(int argc, char *argv[]) -> int
             screen->show_cursor(true);
             auto border = screen->create<SimpleBorder>(3, 4);
             auto line = border->create<InputLine>("New word: ");
+            startup_timer.pause();
             line->run_modal();
+            startup_timer.resume();
             if (line->is_cancelled()) {
                 throw std::runtime_error("You must add at least one word");
             }
@@ -163,14 +416,37 @@ auto main(int argc, char *argv[]) -> int
 
         auto layout = screen->create<VerticalLayout>();
         auto border = layout->create<SimpleBorder>(3, 4);
-        layout->create<Footer>();
+        auto footer = layout->create<Footer>();
         auto progress = layout->create<ProgressBar>(ColorScheme::Blue);
         auto main_window =
             border->create<MainWindow>(screen, progress, model, current_card_idx);
+        model->spawn(model->anki_watch_changes());
+        startup_timer.stop("review");
         screen->run_modal();
         main_window->save_state();
+        main_window->get_latency_stats().dump(Config::instance().get_latency_filepath());
+        model->save_kindle_watermark();
+        if (timings) {
+            for (const auto &[name, stats] :
+                 {std::pair{"main window", main_window->get_paint_stats()},
+                  std::pair{"footer", footer->get_paint_stats()}}) {
+                fmt::print(
+                    stderr, "Painted {} frames of the {}, rewrote {} lines\n",
+                    stats.frames, name, stats.lines);
+            }
+            for (const auto &stage : model->get_import_stats()) {
+                fmt::print(
+                    stderr, "Import stage {} on {} workers: {} in, {} out, busy {} ms\n",
+                    stage.name, stage.workers, stage.items_in, stage.items_out,
+                    stage.busy.count() / 1000);
+            }
+            for (const auto &entry : main_window->get_latency_stats().summary()) {
+                fmt::print(stderr, "Latency p50/p99 of {}\n", entry);
+            }
+        }
     }
     catch (const std::exception &e) {
         log::error("Error from main: {}", e.what());
     }
+    startup_timer.report(timings);
 }
@@ -1,6 +1,52 @@
 #include "anki_client.hpp"
+#include "anki_tape.hpp"
+#include "memory_stats.hpp"
+#include <algorithm>
+#include <thread>
 
-AnkiClient::AnkiClient()
+constexpr auto anki_connect_url = "http://127.0.0.1:8765";
+
+// Queries can't be checked for notes added in Anki itself, so they expire
+constexpr auto cache_ttl = std::chrono::minutes(1);
+constexpr size_t max_cache_size = 4096;
+
+static const std::vector<std::string> headers{
+    "Accept: application/json", "Content-Type: application/json", "charsets: utf-8"};
+
+/// Appends the string as a JSON string literal
+static void append_json_string(fmt::memory_buffer &buffer, std::string_view str)
+{
+    buffer.push_back('"');
+    for (const char c : str) {
+        switch (c) {
+        case '"':
+        case '\\':
+            buffer.push_back('\\');
+            buffer.push_back(c);
+            break;
+        case '\n':
+            buffer.append(std::string_view("\\n"));
+            break;
+        case '\t':
+            buffer.append(std::string_view("\\t"));
+            break;
+        default:
+            if (static_cast<uint8_t>(c) < 0x20) {
+                fmt::format_to(
+                    std::back_inserter(buffer), "\\u{:04x}", static_cast<int>(c));
+            }
+            else {
+                buffer.push_back(c);
+            }
+        }
+    }
+    buffer.push_back('"');
+}
+
+AnkiClient::AnkiClient(
+    std::shared_ptr<AnkiTape> tape, const BatchController::Limits &batch_limits) :
+    tape(std::move(tape)),
+    batch_limits(batch_limits)
 {
     session.set_json_headers();
 }
@@ -8,14 +54,268 @@ AnkiClient::AnkiClient()
 nlohmann::json AnkiClient::request(
     const std::string &action, const nlohmann::json &params)
 {
-    nlohmann::json json;
-    json["action"] = action;
-    json["version"] = 6;
+    std::lock_guard lock(mutex);
+    if (action == "findNotes") {
+        return find_notes(params.at("query").get_ref<const std::string &>());
+    }
+    if (action == "notesInfo" && params.contains("notes")) {
+        return notes_info(params.at("notes").get<std::vector<uint64_t>>());
+    }
+    params_buffer.clear();
     if (!params.is_null()) {
-        json["params"] = params;
+        const auto text = params.dump();
+        params_buffer.append(text.data(), text.data() + text.size());
+    }
+    if (action == "version") {
+        return cached_request(action, {}, {});
+    }
+    auto result = perform_request(action);
+    invalidate_after(action, params);
+    return result;
+}
+
+nlohmann::json AnkiClient::find_notes(std::string_view query)
+{
+    std::lock_guard lock(mutex);
+    params_buffer.clear();
+    fmt::format_to(std::back_inserter(params_buffer), "{{\"query\":");
+    append_json_string(params_buffer, query);
+    params_buffer.push_back('}');
+    return cached_request("findNotes", query, {});
+}
+
+nlohmann::json AnkiClient::notes_info(const std::vector<uint64_t> &note_ids)
+{
+    auto result = nlohmann::json::array();
+    // Other threads may send their requests between the batches
+    for (size_t pos = 0; pos < note_ids.size();) {
+        std::lock_guard lock(mutex);
+        const auto count =
+            std::min(get_batch_size("notesInfo"), note_ids.size() - pos);
+        const std::vector<uint64_t> batch(
+            note_ids.begin() + pos, note_ids.begin() + pos + count);
+        params_buffer.clear();
+        fmt::format_to(
+            std::back_inserter(params_buffer), "{{\"notes\":[{}]}}",
+            fmt::join(batch, ","));
+        for (auto &note : cached_request("notesInfo", {}, batch)) {
+            result.push_back(std::move(note));
+        }
+        pos += count;
+    }
+    return result;
+}
+
+std::vector<std::vector<uint64_t>> AnkiClient::find_notes(
+    const std::vector<std::string> &queries)
+{
+    std::vector<nlohmann::json> params;
+    for (const auto &query : queries) {
+        params.push_back({{"query", query}});
+    }
+    std::vector<std::vector<uint64_t>> result;
+    for (const auto &item : bulk_request("findNotes", params)) {
+        if (!item.at("error").is_null()) {
+            throw std::runtime_error(
+                "AnkiConnect error: " + item["error"].get<std::string>());
+        }
+        result.push_back(item.at("result").get<std::vector<uint64_t>>());
+    }
+    return result;
+}
+
+nlohmann::json AnkiClient::bulk_request(
+    const std::string &action, const std::vector<nlohmann::json> &params)
+{
+    auto result = nlohmann::json::array();
+    for (size_t pos = 0; pos < params.size();) {
+        std::lock_guard lock(mutex);
+        auto &controller = get_batch_controller(action);
+        const auto count = std::min(controller.get_size(), params.size() - pos);
+        auto actions = nlohmann::json::array();
+        for (size_t idx = pos; idx < pos + count; ++idx) {
+            actions.push_back(
+                {{"action", action}, {"version", 6}, {"params", params[idx]}});
+        }
+        const auto start = std::chrono::steady_clock::now();
+        auto results = request("multi", {{"actions", std::move(actions)}});
+        report_batch(controller, count, start);
+        for (auto &item : results) {
+            result.push_back(std::move(item));
+        }
+        pos += count;
+    }
+    return result;
+}
+
+size_t AnkiClient::get_batch_size(const std::string &action)
+{
+    std::lock_guard lock(mutex);
+    return get_batch_controller(action).get_size();
+}
+
+BatchController &AnkiClient::get_batch_controller(const std::string &action)
+{
+    return batch_controllers.try_emplace(action, batch_limits).first->second;
+}
+
+void AnkiClient::report_batch(
+    BatchController &controller, size_t items,
+    std::chrono::steady_clock::time_point start)
+{
+    // Adapted sizes would change the requests, which must match the recorded ones
+    if (tape) {
+        return;
+    }
+    controller.report(
+        items,
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start),
+        response_buffer.size());
+}
+
+nlohmann::json AnkiClient::cached_request(
+    std::string_view action, std::string_view query,
+    const std::vector<uint64_t> &note_ids)
+{
+    key_buffer.assign(action);
+    key_buffer.append(params_buffer.data(), params_buffer.size());
+    const auto start = std::chrono::steady_clock::now();
+    if (auto it = cache.find(key_buffer); it != cache.end()) {
+        if (start < it->second.expiry) {
+            return it->second.result;
+        }
+        cache.erase(it);
+    }
+    auto result = perform_request(action);
+    if (!note_ids.empty()) {
+        report_batch(get_batch_controller(std::string(action)), note_ids.size(), start);
     }
-    const auto response =
-        nlohmann::json::parse(session.post("http://127.0.0.1:8765", json.dump()));
+    CacheEntry entry{
+        std::string(action), std::string(query), result, note_ids, start + cache_ttl};
+    if (action == "findNotes") {
+        entry.note_ids = result.get<std::vector<uint64_t>>();
+    }
+    else if (action == "notesInfo") {
+        // Notes deleted in Anki must not be found by cached queries either
+        std::vector<uint64_t> deleted;
+        for (size_t idx = 0; idx < result.size() && idx < note_ids.size(); ++idx) {
+            if (result[idx].empty()) {
+                deleted.push_back(note_ids[idx]);
+            }
+        }
+        if (!deleted.empty()) {
+            invalidate_notes(deleted);
+            return result;
+        }
+    }
+    if (cache.size() >= max_cache_size) {
+        std::erase_if(cache, [start](const auto &item) {
+            return item.second.expiry <= start;
+        });
+    }
+    if (cache.size() >= max_cache_size) {
+        cache.erase(std::min_element(
+            cache.begin(), cache.end(), [](const auto &lhs, const auto &rhs) {
+                return lhs.second.expiry < rhs.second.expiry;
+            }));
+    }
+    cache.emplace(key_buffer, std::move(entry));
+    return result;
+}
+
+std::unordered_map<uint64_t, int64_t> AnkiClient::get_cached_note_mods()
+{
+    std::lock_guard lock(mutex);
+    std::unordered_map<uint64_t, int64_t> result;
+    for (const auto &[key, entry] : cache) {
+        if (entry.action != "notesInfo") {
+            continue;
+        }
+        for (const auto &note : entry.result) {
+            if (!note.empty()) {
+                result.emplace(note.at("noteId").get<uint64_t>(), note.value("mod", 0));
+            }
+        }
+    }
+    return result;
+}
+
+void AnkiClient::invalidate_notes(const std::vector<uint64_t> &note_ids)
+{
+    std::lock_guard lock(mutex);
+    std::erase_if(cache, [&note_ids](const auto &item) {
+        const auto &ids = item.second.note_ids;
+        return std::find_first_of(
+                   ids.begin(), ids.end(), note_ids.begin(), note_ids.end()) != ids.end();
+    });
+}
+
+nlohmann::json AnkiClient::perform_request(std::string_view action)
+{
+    body_buffer.clear();
+    fmt::format_to(
+        std::back_inserter(body_buffer), "{{\"action\":\"{}\",\"version\":6", action);
+    if (params_buffer.size()) {
+        fmt::format_to(std::back_inserter(body_buffer), ",\"params\":");
+        body_buffer.append(params_buffer);
+    }
+    body_buffer.push_back('}');
+    const std::string_view body{body_buffer.data(), body_buffer.size()};
+    if (tape && tape->is_replaying()) {
+        const auto exchange = tape->replay(body);
+        std::this_thread::sleep_for(exchange.latency);
+        response_buffer.assign(exchange.response);
+        return get_result(action, response_buffer);
+    }
+    const auto start = std::chrono::steady_clock::now();
+    session.post(anki_connect_url, body, response_buffer);
+    if (tape) {
+        tape->record(
+            body, response_buffer,
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start));
+    }
+    return get_result(action, response_buffer);
+}
+
+Task<nlohmann::json> AnkiClient::async_request(
+    EventLoop &loop, std::string action, nlohmann::json params)
+{
+    nlohmann::json body{{"action", action}, {"version", 6}};
+    if (!params.is_null()) {
+        body["params"] = params;
+    }
+    std::string response;
+    if (tape && tape->is_replaying()) {
+        const auto exchange = tape->replay(body.dump());
+        co_await loop.sleep_for(
+            std::chrono::ceil<std::chrono::milliseconds>(exchange.latency));
+        response = exchange.response;
+    }
+    else {
+        auto request = body.dump();
+        const auto start = EventLoop::Clock::now();
+        response = co_await loop.http_post(anki_connect_url, request, headers);
+        if (tape) {
+            tape->record(
+                request, response,
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    EventLoop::Clock::now() - start));
+        }
+    }
+    auto result = get_result(action, response);
+    {
+        std::lock_guard lock(mutex);
+        invalidate_after(action, params);
+    }
+    co_return result;
+}
+
+nlohmann::json AnkiClient::get_result(std::string_view action, const std::string &text)
+{
+    MemoryStats::Scope memory_scope(MemoryStats::Tag::Json);
+    const auto response = nlohmann::json::parse(text);
     if (!response.at("error").is_null()) {
         throw std::runtime_error(
             "AnkiConnect error: " + response["error"].get<std::string>());
@@ -29,3 +329,64 @@ nlohmann::json AnkiClient::request(
     }
     return response.at("result");
 }
+
+void AnkiClient::invalidate_after(const std::string &action, const nlohmann::json &params)
+{
+    // Read-only actions, including the reads of a multi
+    if (action == "guiBrowse" || action == "findNotes" || action == "notesInfo" ||
+        action == "notesModTime") {
+        return;
+    }
+    if (action == "multi") {
+        for (const auto &item : params.at("actions")) {
+            invalidate_after(
+                item.at("action").get<std::string>(),
+                item.value("params", nlohmann::json()));
+        }
+        return;
+    }
+    if (action == "addNotes" || action == "addNote") {
+        // A new note may match any query
+        invalidate_queries([](const std::string &) {
+            return true;
+        });
+        return;
+    }
+    if (action == "updateNoteFields") {
+        const auto &note = params.at("note");
+        invalidate_notes({note.at("id").get<uint64_t>()});
+        // The note may start matching queries on the updated fields
+        std::vector<std::string> prefixes;
+        for (const auto &field : note.at("fields").items()) {
+            auto prefix = field.key() + ':';
+            std::transform(prefix.begin(), prefix.end(), prefix.begin(), [](uint8_t c) {
+                return std::tolower(c);
+            });
+            prefixes.push_back(std::move(prefix));
+        }
+        invalidate_queries([&prefixes](const std::string &query) {
+            return std::any_of(
+                prefixes.begin(), prefixes.end(), [&query](const auto &prefix) {
+                    return query.find(prefix) != std::string::npos;
+                });
+        });
+        return;
+    }
+    if (action == "addTags") {
+        invalidate_notes(params.at("notes").get<std::vector<uint64_t>>());
+        invalidate_queries([](const std::string &query) {
+            return query.find("tag:") != std::string::npos;
+        });
+        return;
+    }
+    cache.clear();
+}
+
+void AnkiClient::invalidate_queries(
+    const std::function<bool(const std::string &)> &predicate)
+{
+    std::erase_if(cache, [&predicate](const auto &item) {
+        const auto &entry = item.second;
+        return entry.action == "findNotes" && predicate(entry.query);
+    });
+}
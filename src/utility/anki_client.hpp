@@ -1,19 +1,104 @@
 #ifndef ANKI_CLIENT_HPP
 #define ANKI_CLIENT_HPP
 
+#include "batch_controller.hpp"
 #include "curl_request.hpp"
+#include "event_loop.hpp"
+#include <chrono>
+#include <fmt/format.h>
+#include <functional>
+#include <memory>
 #include <libs/json.hpp>
+#include <mutex>
+#include <unordered_map>
 
+class AnkiTape;
+
+/// Requests from several threads are serialized over the single session
 class AnkiClient
 {
 public:
-    AnkiClient();
+    /// The traffic is recorded to the tape, or replayed from it instead of sent
+    explicit AnkiClient(
+        std::shared_ptr<AnkiTape> tape = {},
+        const BatchController::Limits &batch_limits = {});
+
+    /** Responses of read-only actions are cached until a write touches their notes
 
+        Entries expire after a minute and the oldest are dropped when the
+        cache is full. Edits made in Anki itself are found by the change watcher
+    */
     nlohmann::json request(
         const std::string &action, const nlohmann::json &params = nullptr);
 
+    /// Typed requests, serialized straight into the reused request buffer
+    nlohmann::json find_notes(std::string_view query);
+    /// Sent in batches sized by the notesInfo controller
+    nlohmann::json notes_info(const std::vector<uint64_t> &note_ids);
+    /// The notes found by every query, in batched multi requests
+    std::vector<std::vector<uint64_t>> find_notes(
+        const std::vector<std::string> &queries);
+
+    /** Sends the action once per params in multi requests
+
+        The batch sizes adapt to the latency and response size of the action.
+        They stay at the initial size while recording or replaying, so a
+        replay sends the same requests as the recording. Returns the result
+        and error of every action, as multi does
+    */
+    nlohmann::json bulk_request(
+        const std::string &action, const std::vector<nlohmann::json> &params);
+    size_t get_batch_size(const std::string &action);
+
+    /** Sends the request on the event loop without blocking the caller
+
+        The response bypasses the cache, but a write still invalidates it
+    */
+    Task<nlohmann::json> async_request(
+        EventLoop &loop, std::string action, nlohmann::json params = nullptr);
+
+    /// Drops cached responses involving the notes, e.g. after an edit in Anki itself
+    void invalidate_notes(const std::vector<uint64_t> &note_ids);
+    /// The modification times of the notes in cached notesInfo responses
+    std::unordered_map<uint64_t, int64_t> get_cached_note_mods();
+
+private:
+    struct CacheEntry
+    {
+        std::string action;
+        std::string query;
+        nlohmann::json result;
+        std::vector<uint64_t> note_ids;
+        std::chrono::steady_clock::time_point expiry;
+    };
+
+    nlohmann::json cached_request(
+        std::string_view action, std::string_view query,
+        const std::vector<uint64_t> &note_ids);
+    /// Sends the action with the params serialized in params_buffer
+    nlohmann::json perform_request(std::string_view action);
+    BatchController &get_batch_controller(const std::string &action);
+    /// Adapts the batch size to the last request, unless the traffic is on tape
+    void report_batch(
+        BatchController &controller, size_t items,
+        std::chrono::steady_clock::time_point start);
+    static nlohmann::json get_result(std::string_view action, const std::string &text);
+    void invalidate_after(const std::string &action, const nlohmann::json &params);
+    void invalidate_queries(const std::function<bool(const std::string &)> &predicate);
+
 private:
+    // Recursive, since a request may invalidate notes through the public API
+    std::recursive_mutex mutex;
     CurlSession session;
+    std::shared_ptr<AnkiTape> tape;
+    const BatchController::Limits batch_limits;
+    std::unordered_map<std::string, BatchController> batch_controllers;
+    std::unordered_map<std::string, CacheEntry> cache;
+    // Reused across requests, so they keep their capacity
+    fmt::memory_buffer params_buffer;
+    fmt::memory_buffer body_buffer;
+    std::string key_buffer;
+    std::string response_buffer;
 };
 
 #endif // ANKI_CLIENT_HPP
@@ -0,0 +1,101 @@
+#include "anki_collection.hpp"
+#include "memory_stats.hpp"
+#include "sqlite_database/sqlite_database.h"
+#include "tools.hpp"
+#include <st/string_functions.hpp>
+#include <unordered_map>
+
+AnkiCollection::AnkiCollection(const std::string &filepath) :
+    db(SqliteDatabase::open_read_only(filepath))
+{}
+
+AnkiCollection::~AnkiCollection() = default;
+
+nlohmann::json AnkiCollection::notes_info(const Filter &filter) const
+{
+    MemoryStats::Scope memory_scope(MemoryStats::Tag::Sqlite);
+    // Card queue: -1 suspended, 1 and 3 learning; card type 0 is new
+    std::string card_condition;
+    switch (filter.cards) {
+    case Cards::Any:
+        break;
+    case Cards::Reviewed:
+        card_condition = " AND c.type != 0 AND c.queue NOT IN (-1, 1, 3)";
+        break;
+    case Cards::Suspended:
+        card_condition = " AND c.queue = -1";
+        break;
+    }
+    std::string tag_condition;
+    if (!filter.tag.empty()) {
+        tag_condition =
+            filter.exclude_tag ? " AND n.tags NOT LIKE ?" : " AND n.tags LIKE ?";
+    }
+
+    execute("BEGIN");
+    try {
+        std::unordered_map<int64_t, std::vector<std::string>> field_names;
+        {
+            auto sql = db->create_query();
+            sql << "SELECT ntid, name FROM fields ORDER BY ntid, ord";
+            while (sql.step()) {
+                const auto notetype = sql.get_int64();
+                field_names[notetype].push_back(sql.get_string());
+            }
+        }
+
+        auto result = nlohmann::json::array();
+        auto sql = db->create_query();
+        // Child decks are separated by \x1f and belong to the deck as in deck: searches.
+        // Deck names are compared as is, the unicase collation exists only in Anki
+        sql << "SELECT n.id, n.mid, n.mod, n.flds, n.tags\n"
+               "FROM notes n\n"
+               "WHERE n.id IN (\n"
+               "    SELECT c.nid FROM cards c JOIN decks d ON c.did = d.id\n"
+               "    WHERE (d.name COLLATE BINARY = ? OR\n"
+               "           substr(d.name, 1, length(?) + 1) = ? || char(31))" +
+                   card_condition + ")" + tag_condition + "\nORDER BY n.id";
+        sql.bind(filter.deck);
+        sql.bind(filter.deck);
+        sql.bind(filter.deck);
+        if (!filter.tag.empty()) {
+            sql.bind("% " + filter.tag + " %");
+        }
+        while (sql.step()) {
+            const auto note_id = sql.get_int64();
+            const auto &names = field_names[sql.get_int64()];
+            const auto mod = sql.get_int64();
+            const auto values = tools::split(sql.get_string(), "\x1f");
+            auto tags = sql.get_string();
+            st::trim(tags);
+            auto tag_list =
+                tags.empty() ? std::vector<std::string>{} : tools::split(tags, " ");
+            auto fields = nlohmann::json::object();
+            for (size_t idx = 0; idx < names.size() && idx < values.size(); ++idx) {
+                fields[names[idx]] = {
+                    {"value", values[idx]},
+                    {"order", idx},
+                };
+            }
+            result.push_back({
+                {"noteId", note_id},
+                {"mod", mod},
+                {"fields", std::move(fields)},
+                {"tags", std::move(tag_list)},
+            });
+        }
+        execute("COMMIT");
+        return result;
+    }
+    catch (...) {
+        execute("ROLLBACK");
+        throw;
+    }
+}
+
+void AnkiCollection::execute(const char *sql) const
+{
+    auto query = db->create_query();
+    query << sql;
+    query.step();
+}
@@ -0,0 +1,46 @@
+#ifndef ANKI_COLLECTION_HPP
+#define ANKI_COLLECTION_HPP
+
+#include <libs/json.hpp>
+#include <memory>
+#include <string>
+
+class SqliteDatabase;
+
+/** Read-only access to the notes of Anki's collection.anki2
+
+    Every read runs in a single SQLite read transaction, so it sees one
+    consistent state of the collection. Notes are returned in the shape of
+    AnkiConnect notesInfo results. Anki keeps the collection locked while it
+    is running, then reads fail and callers fall back to AnkiConnect
+*/
+class AnkiCollection
+{
+public:
+    enum class Cards : uint8_t {
+        Any,
+        Reviewed, ///< -is:new -is:learn -is:suspended
+        Suspended,
+    };
+
+    struct Filter
+    {
+        std::string deck;
+        Cards cards = Cards::Any;
+        std::string tag = {};
+        bool exclude_tag = false;
+    };
+
+    explicit AnkiCollection(const std::string &filepath);
+    ~AnkiCollection();
+
+    nlohmann::json notes_info(const Filter &filter) const;
+
+private:
+    void execute(const char *sql) const;
+
+private:
+    std::shared_ptr<SqliteDatabase> db;
+};
+
+#endif // ANKI_COLLECTION_HPP
@@ -0,0 +1,105 @@
+#include "anki_tape.hpp"
+#include "mapped_file.hpp"
+#include <cstring>
+#include <libs/json.hpp>
+
+constexpr char anki_tape_magic[4] = {'V', 'B', 'A', 'T'};
+constexpr uint32_t anki_tape_version = 1;
+
+AnkiTape::AnkiTape(const std::string &filename, Mode mode, double speed) :
+    mode(mode),
+    speed(speed)
+{
+    if (mode == Mode::Record) {
+        out.open(filename, std::ios::binary | std::ios::trunc);
+        st::assert_or_throw(out.is_open(), "Can not open file {}", filename);
+        Header header{};
+        std::memcpy(header.magic, anki_tape_magic, sizeof(header.magic));
+        header.version = anki_tape_version;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.flush();
+    }
+    else {
+        file = std::make_unique<MappedFile>(filename);
+        load();
+    }
+}
+
+AnkiTape::~AnkiTape() = default;
+
+bool AnkiTape::is_replaying() const
+{
+    return mode == Mode::Replay;
+}
+
+void AnkiTape::record(
+    std::string_view request, std::string_view response,
+    std::chrono::microseconds latency)
+{
+    const auto key = make_key(request);
+    const ExchangeHeader header{
+        static_cast<uint32_t>(latency.count()), static_cast<uint32_t>(key.size()),
+        static_cast<uint32_t>(response.size())};
+    std::lock_guard lock(mutex);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(key.data(), key.size());
+    out.write(response.data(), response.size());
+    // Flushed per exchange, so a crashed session is still recorded
+    out.flush();
+}
+
+AnkiTape::Exchange AnkiTape::replay(std::string_view request)
+{
+    const auto key = make_key(request);
+    auto it = exchanges.find(key);
+    if (it == exchanges.end()) {
+        throw std::runtime_error("The request has not been recorded: " + key);
+    }
+    std::lock_guard lock(mutex);
+    auto &cursor = cursors[key];
+    auto exchange = it->second.at(std::min(cursor, it->second.size() - 1));
+    ++cursor;
+    if (speed > 0) {
+        exchange.latency = std::chrono::microseconds(
+            static_cast<int64_t>(static_cast<double>(exchange.latency.count()) / speed));
+    }
+    else {
+        exchange.latency = {};
+    }
+    return exchange;
+}
+
+std::string AnkiTape::make_key(std::string_view request)
+{
+    return nlohmann::json::parse(request).dump();
+}
+
+void AnkiTape::load()
+{
+    const auto data = file->view();
+    st::assert_or_throw(
+        data.size() >= sizeof(Header) &&
+            std::memcmp(data.data(), anki_tape_magic, sizeof(anki_tape_magic)) == 0,
+        "Not an Anki tape file");
+    Header header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    st::assert_or_throw(
+        header.version == anki_tape_version, "Unsupported Anki tape version {}",
+        header.version);
+    for (size_t pos = sizeof(Header); pos < data.size();) {
+        ExchangeHeader exchange;
+        st::assert_or_throw(
+            pos + sizeof(exchange) <= data.size(), "Truncated Anki tape file");
+        std::memcpy(&exchange, data.data() + pos, sizeof(exchange));
+        pos += sizeof(exchange);
+        st::assert_or_throw(
+            pos + exchange.request_size + exchange.response_size <= data.size(),
+            "Truncated Anki tape file");
+        std::string key(data.substr(pos, exchange.request_size));
+        pos += exchange.request_size;
+        exchanges[std::move(key)].push_back(
+            {data.substr(pos, exchange.response_size),
+             std::chrono::microseconds(exchange.latency_us)});
+        pos += exchange.response_size;
+    }
+}
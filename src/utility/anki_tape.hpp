@@ -0,0 +1,76 @@
+#ifndef ANKI_TAPE_HPP
+#define ANKI_TAPE_HPP
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class MappedFile;
+
+/** Recorded AnkiConnect traffic
+
+    In Record mode every exchange is appended to the file with its latency.
+    In Replay mode the file serves the responses instead of AnkiConnect. The
+    same request replays its recorded responses in order, the last one once
+    they run out. Requests are matched by their JSON content, whatever the
+    formatting. Layout: header, then per exchange the latency in microseconds,
+    the request and response sizes, the request and the response
+*/
+class AnkiTape
+{
+public:
+    enum class Mode : uint8_t {
+        Record,
+        Replay,
+    };
+
+    struct Exchange
+    {
+        std::string_view response;
+        std::chrono::microseconds latency;
+    };
+
+    /// Replayed latencies are divided by the speed, or skipped if it is 0
+    AnkiTape(const std::string &filename, Mode mode, double speed = 1);
+    ~AnkiTape();
+
+    bool is_replaying() const;
+    void record(
+        std::string_view request, std::string_view response,
+        std::chrono::microseconds latency);
+    /// Throws if the request has not been recorded
+    Exchange replay(std::string_view request);
+
+private:
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+    };
+
+    struct ExchangeHeader
+    {
+        uint32_t latency_us;
+        uint32_t request_size;
+        uint32_t response_size;
+    };
+
+    static std::string make_key(std::string_view request);
+    void load();
+
+private:
+    const Mode mode;
+    const double speed;
+    std::mutex mutex;
+    std::ofstream out;
+    std::unique_ptr<MappedFile> file;
+    std::unordered_map<std::string, std::vector<Exchange>> exchanges;
+    std::unordered_map<std::string, size_t> cursors;
+};
+
+#endif // ANKI_TAPE_HPP
@@ -0,0 +1,24 @@
+#include "batch_controller.hpp"
+#include <algorithm>
+
+BatchController::BatchController(const Limits &limits) :
+    limits(limits),
+    size(std::clamp(limits.min_size * 5, limits.min_size, limits.max_size))
+{}
+
+size_t BatchController::get_size() const
+{
+    return size;
+}
+
+void BatchController::report(
+    size_t items, std::chrono::microseconds latency, size_t response_bytes)
+{
+    if (latency > limits.target_latency || response_bytes > limits.max_response_bytes) {
+        size = std::max(limits.min_size, size / 2);
+    }
+    // A partial batch says nothing about a larger one
+    else if (items >= size) {
+        size = std::min(limits.max_size, size + limits.step);
+    }
+}
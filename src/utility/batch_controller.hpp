@@ -0,0 +1,36 @@
+#ifndef BATCH_CONTROLLER_HPP
+#define BATCH_CONTROLLER_HPP
+
+#include <chrono>
+#include <cstddef>
+
+/** The class sizes the batches of a bulk operation from their cost
+
+    The size grows by a step after every full batch that stayed within the
+    latency target and the response limit, and halves after one that did
+    not (AIMD). Slow batches mean Anki's window is blocked while it serves
+    them, so the target trades throughput for a responsive Anki
+*/
+class BatchController
+{
+public:
+    struct Limits
+    {
+        size_t min_size = 10;
+        size_t max_size = 1000;
+        size_t step = 10;
+        std::chrono::milliseconds target_latency{250};
+        size_t max_response_bytes = 4 << 20;
+    };
+
+    explicit BatchController(const Limits &limits);
+
+    size_t get_size() const;
+    void report(size_t items, std::chrono::microseconds latency, size_t response_bytes);
+
+private:
+    const Limits limits;
+    size_t size;
+};
+
+#endif // BATCH_CONTROLLER_HPP
@@ -0,0 +1,196 @@
+#include "bk_tree.hpp"
+#include "file.hpp"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <map>
+
+struct BkTreeHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t stamp;
+    uint64_t node_count;
+    uint64_t pool_size;
+};
+
+constexpr char bk_tree_magic[4] = {'V', 'B', 'B', 'K'};
+constexpr uint32_t bk_tree_version = 1;
+
+BkTree::BkTree(std::vector<std::string> words)
+{
+    struct TempNode
+    {
+        std::string_view word;
+        std::map<size_t, size_t> children;
+    };
+
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    std::vector<TempNode> tree;
+    tree.reserve(words.size());
+    for (const auto &str : words) {
+        if (str.empty() || str.size() > UINT16_MAX) {
+            continue;
+        }
+        if (tree.empty()) {
+            tree.push_back({str, {}});
+            continue;
+        }
+        for (size_t idx = 0;;) {
+            const auto dist = distance(str, tree[idx].word);
+            auto [it, inserted] = tree[idx].children.emplace(dist, tree.size());
+            if (inserted) {
+                tree.push_back({str, {}});
+                break;
+            }
+            idx = it->second;
+        }
+    }
+    if (tree.empty()) {
+        return;
+    }
+
+    std::deque<std::pair<size_t, size_t>> queue{
+        {0, 0}
+    };
+    nodes.reserve(tree.size());
+    while (!queue.empty()) {
+        const auto [idx, dist] = queue.front();
+        queue.pop_front();
+        const auto &node = tree[idx];
+        const auto children_begin = nodes.size() + queue.size() + 1;
+        nodes.push_back(
+            {static_cast<uint32_t>(pool.size()), static_cast<uint16_t>(node.word.size()),
+             static_cast<uint16_t>(std::min<size_t>(dist, UINT16_MAX)),
+             static_cast<uint32_t>(children_begin),
+             static_cast<uint32_t>(children_begin + node.children.size())});
+        pool.append(node.word);
+        for (const auto &[child_dist, child_idx] : node.children) {
+            queue.emplace_back(child_idx, child_dist);
+        }
+    }
+}
+
+std::vector<BkTree::Match> BkTree::find(std::string_view str, size_t max_distance) const
+{
+    std::vector<Match> result;
+    if (nodes.empty()) {
+        return result;
+    }
+    std::vector<uint32_t> stack{0};
+    while (!stack.empty()) {
+        const auto &node = nodes[stack.back()];
+        stack.pop_back();
+        const auto dist = distance(str, word(node));
+        if (dist <= max_distance) {
+            result.push_back({word(node), dist});
+        }
+        for (auto idx = node.children_begin; idx < node.children_end; ++idx) {
+            const size_t child_dist = nodes[idx].distance;
+            if (child_dist + max_distance >= dist && child_dist <= dist + max_distance) {
+                stack.push_back(idx);
+            }
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const auto &lhs, const auto &rhs) {
+        return std::tie(lhs.distance, lhs.word) < std::tie(rhs.distance, rhs.word);
+    });
+    return result;
+}
+
+bool BkTree::empty() const
+{
+    return nodes.empty();
+}
+
+bool BkTree::load(const std::string &filename, uint64_t stamp)
+{
+    if (!std::filesystem::exists(filename)) {
+        return false;
+    }
+    const auto file_size = std::filesystem::file_size(filename);
+    File file{filename, "r"};
+    BkTreeHeader header;
+    if (std::fread(&header, sizeof(header), 1, file) != 1 ||
+        std::memcmp(header.magic, bk_tree_magic, sizeof(bk_tree_magic)) != 0 ||
+        header.version != bk_tree_version || header.stamp != stamp) {
+        return false;
+    }
+    // A truncated or corrupted index must not size the buffers
+    const auto data_size = file_size - sizeof(header);
+    if (header.node_count > data_size / sizeof(Node) ||
+        header.pool_size != data_size - header.node_count * sizeof(Node)) {
+        return false;
+    }
+    nodes.resize(header.node_count);
+    pool.resize(header.pool_size);
+    if (std::fread(nodes.data(), sizeof(Node), nodes.size(), file) != nodes.size() ||
+        std::fread(pool.data(), 1, pool.size(), file) != pool.size() || !is_valid()) {
+        nodes.clear();
+        pool.clear();
+        return false;
+    }
+    return true;
+}
+
+void BkTree::save(const std::string &filename, uint64_t stamp) const
+{
+    BkTreeHeader header{{}, bk_tree_version, stamp, nodes.size(), pool.size()};
+    std::memcpy(header.magic, bk_tree_magic, sizeof(bk_tree_magic));
+    // Another process loading the previous index keeps reading the old inode
+    const auto tmp_filename = filename + ".tmp";
+    {
+        File out{tmp_filename, "w"};
+        auto write = [&out](const void *data, size_t size, size_t count) {
+            return std::fwrite(data, size, count, out) == count;
+        };
+        st::assert_or_throw(
+            write(&header, sizeof(header), 1) &&
+                write(nodes.data(), sizeof(Node), nodes.size()) &&
+                write(pool.data(), 1, pool.size()),
+            "Can not write fuzzy index {}", tmp_filename);
+    }
+    std::filesystem::rename(tmp_filename, filename);
+}
+
+size_t BkTree::distance(std::string_view lhs, std::string_view rhs)
+{
+    if (lhs.size() < rhs.size()) {
+        std::swap(lhs, rhs);
+    }
+    std::vector<size_t> row(rhs.size() + 1);
+    for (size_t j = 0; j < row.size(); ++j) {
+        row[j] = j;
+    }
+    for (size_t i = 1; i <= lhs.size(); ++i) {
+        auto diagonal = row[0];
+        row[0] = i;
+        for (size_t j = 1; j <= rhs.size(); ++j) {
+            const auto substitution = diagonal + (lhs[i - 1] != rhs[j - 1]);
+            diagonal = row[j];
+            row[j] = std::min({row[j] + 1, row[j - 1] + 1, substitution});
+        }
+    }
+    return row.back();
+}
+
+bool BkTree::is_valid() const
+{
+    // Children follow their parent, so lookups can not loop
+    for (size_t idx = 0; idx < nodes.size(); ++idx) {
+        const auto &node = nodes[idx];
+        if (uint64_t{node.word} + node.word_size > pool.size() ||
+            node.children_begin <= idx || node.children_begin > node.children_end ||
+            node.children_end > nodes.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view BkTree::word(const Node &node) const
+{
+    return {pool.data() + node.word, node.word_size};
+}
@@ -0,0 +1,55 @@
+#ifndef BK_TREE_HPP
+#define BK_TREE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** Burkhard-Keller tree over a word list for approximate lookups
+
+    Nodes are stored flat in breadth-first order with the children of a
+    node being a contiguous range, so the tree can be written to disk and
+    read back as a single block
+*/
+class BkTree
+{
+public:
+    struct Match
+    {
+        std::string_view word;
+        size_t distance;
+    };
+
+    BkTree() = default;
+    explicit BkTree(std::vector<std::string> words);
+
+    /// Returns words within max_distance edits ordered by distance and then by word
+    std::vector<Match> find(std::string_view word, size_t max_distance) const;
+
+    bool empty() const;
+
+    bool load(const std::string &filename, uint64_t stamp);
+    void save(const std::string &filename, uint64_t stamp) const;
+
+    static size_t distance(std::string_view lhs, std::string_view rhs);
+
+private:
+    struct Node
+    {
+        uint32_t word;
+        uint16_t word_size;
+        uint16_t distance;
+        uint32_t children_begin;
+        uint32_t children_end;
+    };
+
+    /// Checks that a loaded index only refers to its own nodes and pool
+    bool is_valid() const;
+    std::string_view word(const Node &node) const;
+
+private:
+    std::string pool;
+    std::vector<Node> nodes;
+};
+
+#endif // BK_TREE_HPP
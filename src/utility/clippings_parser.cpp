@@ -0,0 +1,66 @@
+#include "clippings_parser.hpp"
+
+constexpr std::string_view separator = "==========";
+constexpr std::string_view utf8_bom = "\xEF\xBB\xBF";
+
+ClippingsParser::ClippingsParser(std::string_view data) :
+    data(data)
+{}
+
+bool ClippingsParser::next(Clipping &clipping)
+{
+    while (!data.empty()) {
+        auto entry = data.substr(0, data.find(separator));
+        data.remove_prefix(std::min(data.size(), entry.size() + separator.size()));
+        next_line(data); // rest of the separator line
+        auto book = trim(next_line(entry));
+        if (book.starts_with(utf8_bom)) {
+            book.remove_prefix(utf8_bom.size());
+        }
+        const auto meta = next_line(entry);
+        if (book.empty() || !is_highlight(meta)) {
+            continue;
+        }
+        if (auto text = trim(entry); !text.empty()) {
+            clipping.book = book;
+            clipping.text = text;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ClippingsParser::is_highlight(std::string_view meta)
+{
+    // The last field is the date, which some languages write with dashes
+    meta = meta.substr(0, meta.rfind('|'));
+    const auto is_digit = [](char c) {
+        return c >= '0' && c <= '9';
+    };
+    for (auto pos = meta.find('-'); pos != std::string_view::npos;
+         pos = meta.find('-', pos + 1)) {
+        if (pos > 0 && pos + 1 < meta.size() && is_digit(meta[pos - 1]) &&
+            is_digit(meta[pos + 1])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string_view ClippingsParser::next_line(std::string_view &entry)
+{
+    const auto pos = entry.find('\n');
+    const auto line = entry.substr(0, pos);
+    entry.remove_prefix(pos == std::string_view::npos ? entry.size() : pos + 1);
+    return line;
+}
+
+std::string_view ClippingsParser::trim(std::string_view str)
+{
+    constexpr std::string_view spaces = " \t\r\n";
+    const auto start = str.find_first_not_of(spaces);
+    if (start == std::string_view::npos) {
+        return {};
+    }
+    return str.substr(start, str.find_last_not_of(spaces) - start + 1);
+}
@@ -0,0 +1,38 @@
+#ifndef CLIPPINGS_PARSER_HPP
+#define CLIPPINGS_PARSER_HPP
+
+#include <string_view>
+
+/** Streaming parser for the Kindle "My Clippings.txt" file
+
+    Entries are separated by "==========" lines. Each entry consists of the
+    book title line, the metadata line ("- Your Highlight on page 5 | ..."),
+    an empty line and the clipped text. The parser returns views into the
+    given buffer and never copies the data
+*/
+class ClippingsParser
+{
+public:
+    struct Clipping
+    {
+        std::string_view book;
+        std::string_view text;
+    };
+
+    explicit ClippingsParser(std::string_view data);
+
+    /// Advances to the next highlight skipping notes and bookmarks
+    bool next(Clipping &clipping);
+
+private:
+    /// Highlights cover a location range ("Location 70-72"), notes and
+    /// bookmarks a single location, whatever the language of the Kindle
+    static bool is_highlight(std::string_view meta);
+    static std::string_view next_line(std::string_view &entry);
+    static std::string_view trim(std::string_view str);
+
+private:
+    std::string_view data;
+};
+
+#endif // CLIPPINGS_PARSER_HPP
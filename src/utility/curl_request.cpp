@@ -1,11 +1,35 @@
 #include "curl_request.hpp"
+#include "memory_stats.hpp"
 #include <curl/curl.h>
+#include <stdexcept>
 
-CurlSession::CurlSession()
+namespace {
+
+struct CurlGlobal
 {
-    if (auto res = curl_global_init(CURL_GLOBAL_ALL); res != CURLE_OK) {
-        throw std::runtime_error(curl_easy_strerror(res));
+    CurlGlobal()
+    {
+        if (auto res = curl_global_init(CURL_GLOBAL_ALL); res != CURLE_OK) {
+            throw std::runtime_error(curl_easy_strerror(res));
+        }
     }
+
+    ~CurlGlobal()
+    {
+        curl_global_cleanup();
+    }
+};
+
+} // namespace
+
+void CurlSession::init_global()
+{
+    static CurlGlobal global;
+}
+
+CurlSession::CurlSession()
+{
+    init_global();
     if (!(curl = curl_easy_init())) {
         throw std::runtime_error("Can't init curl library");
     }
@@ -17,7 +41,6 @@ CurlSession::~CurlSession()
 {
     curl_slist_free_all(headers);
     curl_easy_cleanup(curl);
-    curl_global_cleanup();
 }
 
 void CurlSession::set_json_headers()
@@ -51,15 +74,16 @@ void CurlSession::clear_headers()
 std::string CurlSession::get(const char *url)
 {
     curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "GET");
-    return perform_request(url);
+    std::string result;
+    perform_request(url, result);
+    return result;
 }
 
 std::string CurlSession::post(const char *url, const std::string &data)
 {
-    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, data.size());
-    return perform_request(url);
+    std::string result;
+    post(url, data, result);
+    return result;
 }
 
 std::string CurlSession::put(const char *url, const std::string &data)
@@ -67,12 +91,23 @@ std::string CurlSession::put(const char *url, const std::string &data)
     curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
     curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, data.size());
-    return perform_request(url);
+    std::string result;
+    perform_request(url, result);
+    return result;
+}
+
+void CurlSession::post(const char *url, std::string_view data, std::string &response)
+{
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.data());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, data.size());
+    response.clear();
+    perform_request(url, response);
 }
 
-std::string CurlSession::perform_request(const char *url)
+void CurlSession::perform_request(const char *url, std::string &result)
 {
-    std::string result;
+    MemoryStats::Scope memory_scope(MemoryStats::Tag::Curl);
     curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, read_callback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &result);
@@ -81,7 +116,6 @@ std::string CurlSession::perform_request(const char *url)
         (res = curl_easy_perform(curl)) != CURLE_OK) {
         throw std::runtime_error(curl_easy_strerror(res));
     }
-    return result;
 }
 
 size_t CurlSession::read_callback(void *data, size_t size, size_t nmemb, void *ptr)
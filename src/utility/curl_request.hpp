@@ -2,6 +2,7 @@
 #define CURL_REQUEST_HPP
 
 #include <string>
+#include <string_view>
 
 typedef void CURL;
 
@@ -11,6 +12,9 @@ public:
     CurlSession();
     ~CurlSession();
 
+    /// Initializes libcurl once. Its global init isn't thread-safe, so call it early
+    static void init_global();
+
     void set_json_headers();
     void set_header(const char *value);
     void set_useragent(const char *value);
@@ -22,8 +26,11 @@ public:
     std::string post(const char *url, const std::string &data);
     std::string put(const char *url, const std::string &data);
 
+    /// Writes the response into the given buffer, reusing its capacity
+    void post(const char *url, std::string_view data, std::string &response);
+
 private:
-    std::string perform_request(const char *url);
+    void perform_request(const char *url, std::string &result);
     static size_t read_callback(void *data, size_t size, size_t nmemb, void *ptr);
 
 private:
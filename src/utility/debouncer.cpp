@@ -0,0 +1,59 @@
+#include "debouncer.hpp"
+#include <st/logger.hpp>
+
+Debouncer::Debouncer(std::chrono::milliseconds delay) :
+    delay(delay),
+    worker(&Debouncer::run, this)
+{}
+
+Debouncer::~Debouncer()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopped = true;
+        current.request_stop();
+    }
+    cv.notify_one();
+    worker.join();
+}
+
+void Debouncer::schedule(Task task)
+{
+    {
+        std::lock_guard lock(mutex);
+        current.request_stop();
+        current = std::stop_source();
+        pending = std::move(task);
+        deadline = std::chrono::steady_clock::now() + delay;
+    }
+    cv.notify_one();
+}
+
+void Debouncer::run()
+{
+    std::unique_lock lock(mutex);
+    while (true) {
+        cv.wait(lock, [this] { return stopped || pending; });
+        // Every reschedule moves the deadline, so wait until it stops moving
+        while (!stopped && cv.wait_until(lock, deadline) != std::cv_status::timeout) {
+        }
+        if (stopped) {
+            return;
+        }
+        if (!pending || std::chrono::steady_clock::now() < deadline) {
+            continue;
+        }
+        auto task = std::move(pending);
+        pending = nullptr;
+        auto token = current.get_token();
+        lock.unlock();
+        // The worker must survive a failed task, there is nobody to catch it
+        try {
+            task(token);
+        }
+        catch (const std::exception &e) {
+            st::log::error("Error from a debounced task: {}", e.what());
+        }
+        lock.lock();
+    }
+}
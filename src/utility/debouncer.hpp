@@ -0,0 +1,43 @@
+#ifndef DEBOUNCER_HPP
+#define DEBOUNCER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+
+/** The class runs the latest scheduled task once scheduling has settled
+
+    Tasks run on a worker thread after no new task has been scheduled for
+    the delay. A new task supersedes the pending one and requests the
+    running one to stop through its stop token
+*/
+class Debouncer
+{
+public:
+    using Task = std::function<void(std::stop_token)>;
+
+    explicit Debouncer(std::chrono::milliseconds delay);
+    ~Debouncer();
+    Debouncer(const Debouncer &) = delete;
+    Debouncer &operator=(const Debouncer &) = delete;
+
+    void schedule(Task task);
+
+private:
+    void run();
+
+private:
+    const std::chrono::milliseconds delay;
+    std::mutex mutex;
+    std::condition_variable cv;
+    Task pending;
+    std::stop_source current;
+    std::chrono::steady_clock::time_point deadline;
+    bool stopped = false;
+    std::thread worker;
+};
+
+#endif // DEBOUNCER_HPP
@@ -0,0 +1,387 @@
+#include "event_loop.hpp"
+#include "curl_request.hpp"
+#include "memory_stats.hpp"
+#include <algorithm>
+#include <curl/curl.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <st/assert_or_throw.hpp>
+#include <st/logger.hpp>
+#include <unistd.h>
+
+struct EventLoop::Transfer
+{
+    CURL *easy{};
+    curl_slist *headers{};
+    std::string body;
+    std::string response;
+    CURLcode result = CURLE_OK;
+    std::coroutine_handle<> handle;
+
+    ~Transfer()
+    {
+        curl_slist_free_all(headers);
+        if (easy) {
+            curl_easy_cleanup(easy);
+        }
+    }
+};
+
+namespace {
+
+// Frame addresses, as not every standard library can hash a coroutine handle
+using Frames = std::unordered_set<void *>;
+
+/// Runs a spawned task to completion and frees its frame, which is tracked
+/// until then, so the loop can destroy the frames still suspended on stop
+struct Detached
+{
+    struct promise_type
+    {
+        promise_type(Task<void> &, Frames &frames) :
+            frames(frames)
+        {
+            frames.insert(
+                std::coroutine_handle<promise_type>::from_promise(*this).address());
+        }
+
+        ~promise_type()
+        {
+            frames.erase(
+                std::coroutine_handle<promise_type>::from_promise(*this).address());
+        }
+
+        Detached get_return_object() const noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() const noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend() const noexcept
+        {
+            return {};
+        }
+
+        void return_void() const noexcept
+        {}
+
+        void unhandled_exception() const noexcept
+        {}
+
+        Frames &frames;
+    };
+};
+
+Detached run_detached(Task<void> task, Frames &)
+{
+    try {
+        co_await task;
+    }
+    catch (const std::exception &e) {
+        st::log::error("Error from a background task: {}", e.what());
+    }
+}
+
+size_t write_callback(char *data, size_t size, size_t nmemb, void *response)
+{
+    static_cast<std::string *>(response)->append(data, size * nmemb);
+    return size * nmemb;
+}
+
+} // namespace
+
+EventLoop::EventLoop()
+{
+    CurlSession::init_global();
+    if (!(multi = curl_multi_init())) {
+        throw std::runtime_error("Can't init curl library");
+    }
+    curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, socket_callback);
+    curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, timer_callback);
+    curl_multi_setopt(multi, CURLMOPT_TIMERDATA, this);
+    st::assert_or_throw(::pipe(wake_pipe) == 0, "Can not create a pipe");
+    for (const int fd : wake_pipe) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+}
+
+EventLoop::~EventLoop()
+{
+    curl_multi_cleanup(multi);
+    ::close(wake_pipe[0]);
+    ::close(wake_pipe[1]);
+}
+
+void EventLoop::run()
+{
+    while (run_posted()) {
+        poll_once();
+    }
+    // A destroyed frame destroys the tasks it awaits, and their transfers leave
+    // the multi handle
+    const auto suspended = frames;
+    for (auto frame : suspended) {
+        std::coroutine_handle<>::from_address(frame).destroy();
+    }
+    timers = {};
+    watchers.clear();
+}
+
+void EventLoop::stop()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopped = true;
+    }
+    wake();
+}
+
+void EventLoop::post(std::function<void()> func)
+{
+    {
+        std::lock_guard lock(mutex);
+        posted.push_back(std::move(func));
+    }
+    wake();
+}
+
+void EventLoop::spawn(Task<void> task)
+{
+    {
+        std::lock_guard lock(mutex);
+        spawned.push_back(std::move(task));
+    }
+    wake();
+}
+
+EventLoop::Sleep EventLoop::sleep_for(std::chrono::milliseconds duration)
+{
+    return {*this, Clock::now() + duration};
+}
+
+EventLoop::IoReady EventLoop::readable(int fd)
+{
+    return {*this, fd, POLLIN};
+}
+
+EventLoop::IoReady EventLoop::writable(int fd)
+{
+    return {*this, fd, POLLOUT};
+}
+
+EventLoop::HttpPost EventLoop::http_post(
+    const std::string &url, std::string body, const std::vector<std::string> &headers)
+{
+    auto transfer = std::make_unique<Transfer>();
+    transfer->body = std::move(body);
+    st::assert_or_throw(!!(transfer->easy = curl_easy_init()), "Can't init curl library");
+    for (const auto &header : headers) {
+        transfer->headers = curl_slist_append(transfer->headers, header.c_str());
+    }
+    auto easy = transfer->easy;
+    curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(easy, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(easy, CURLOPT_HTTPHEADER, transfer->headers);
+    curl_easy_setopt(easy, CURLOPT_POSTFIELDS, transfer->body.c_str());
+    curl_easy_setopt(
+        easy, CURLOPT_POSTFIELDSIZE, static_cast<long>(transfer->body.size()));
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, &transfer->response);
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, transfer.get());
+    return {*this, std::move(transfer)};
+}
+
+void EventLoop::Sleep::await_suspend(std::coroutine_handle<> handle)
+{
+    loop.timers.push({deadline, handle});
+}
+
+void EventLoop::IoReady::await_suspend(std::coroutine_handle<> handle)
+{
+    loop.watchers.push_back({fd, events, handle});
+}
+
+EventLoop::HttpPost::HttpPost(EventLoop &loop, std::unique_ptr<Transfer> transfer) :
+    loop(loop),
+    transfer(std::move(transfer))
+{}
+
+EventLoop::HttpPost::HttpPost(HttpPost &&other) = default;
+
+EventLoop::HttpPost::~HttpPost()
+{
+    // A transfer still running belongs to a coroutine destroyed while waiting
+    if (transfer && transfer->handle) {
+        curl_multi_remove_handle(loop.multi, transfer->easy);
+    }
+}
+
+void EventLoop::HttpPost::await_suspend(std::coroutine_handle<> handle)
+{
+    transfer->handle = handle;
+    if (auto res = curl_multi_add_handle(loop.multi, transfer->easy); res != CURLM_OK) {
+        transfer->handle = nullptr;
+        transfer->result = CURLE_FAILED_INIT;
+        loop.post([handle] {
+            handle.resume();
+        });
+    }
+}
+
+std::string EventLoop::HttpPost::await_resume()
+{
+    if (transfer->result != CURLE_OK) {
+        throw std::runtime_error(curl_easy_strerror(transfer->result));
+    }
+    return std::move(transfer->response);
+}
+
+void EventLoop::wake()
+{
+    const char byte = 0;
+    [[maybe_unused]] auto res = ::write(wake_pipe[1], &byte, 1);
+}
+
+bool EventLoop::run_posted()
+{
+    std::vector<std::function<void()>> funcs;
+    std::vector<Task<void>> tasks;
+    {
+        std::lock_guard lock(mutex);
+        if (stopped) {
+            return false;
+        }
+        funcs.swap(posted);
+        tasks.swap(spawned);
+    }
+    for (auto &func : funcs) {
+        func();
+    }
+    for (auto &task : tasks) {
+        run_detached(std::move(task), frames);
+    }
+    return true;
+}
+
+void EventLoop::poll_once()
+{
+    std::vector<pollfd> fds{{wake_pipe[0], POLLIN, 0}};
+    for (const auto &[fd, what] : curl_sockets) {
+        const auto events =
+            (what & CURL_POLL_IN ? POLLIN : 0) | (what & CURL_POLL_OUT ? POLLOUT : 0);
+        fds.push_back({fd, static_cast<short>(events), 0});
+    }
+    const auto curl_end = fds.size();
+    for (const auto &watcher : watchers) {
+        fds.push_back({watcher.fd, watcher.events, 0});
+    }
+
+    std::optional<Clock::time_point> deadline = curl_deadline;
+    if (!timers.empty() && (!deadline || timers.top().deadline < *deadline)) {
+        deadline = timers.top().deadline;
+    }
+    int timeout = -1;
+    if (deadline) {
+        const auto left =
+            std::chrono::ceil<std::chrono::milliseconds>(*deadline - Clock::now());
+        timeout = static_cast<int>(std::max<int64_t>(left.count(), 0));
+    }
+    if (::poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR) {
+        throw std::runtime_error("poll failed");
+    }
+
+    if (fds[0].revents) {
+        char buffer[64];
+        while (::read(wake_pipe[0], buffer, sizeof(buffer)) > 0) {
+        }
+    }
+    for (size_t idx = 1; idx < curl_end; ++idx) {
+        if (const auto revents = fds[idx].revents) {
+            socket_action(
+                fds[idx].fd, (revents & POLLIN ? CURL_CSELECT_IN : 0) |
+                                 (revents & POLLOUT ? CURL_CSELECT_OUT : 0) |
+                                 (revents & (POLLERR | POLLHUP) ? CURL_CSELECT_ERR : 0));
+        }
+    }
+    if (curl_deadline && *curl_deadline <= Clock::now()) {
+        curl_deadline.reset();
+        socket_action(CURL_SOCKET_TIMEOUT, 0);
+    }
+    finish_transfers();
+
+    // Resumed coroutines may start waiting again, so collect them first
+    std::vector<std::coroutine_handle<>> ready;
+    for (size_t idx = curl_end; idx < fds.size(); ++idx) {
+        if (fds[idx].revents) {
+            auto it = std::find_if(
+                watchers.begin(), watchers.end(), [&](const auto &watcher) {
+                    return watcher.fd == fds[idx].fd && watcher.events == fds[idx].events;
+                });
+            if (it != watchers.end()) {
+                ready.push_back(it->handle);
+                watchers.erase(it);
+            }
+        }
+    }
+    const auto now = Clock::now();
+    while (!timers.empty() && timers.top().deadline <= now) {
+        ready.push_back(timers.top().handle);
+        timers.pop();
+    }
+    for (auto handle : ready) {
+        handle.resume();
+    }
+}
+
+void EventLoop::socket_action(int fd, int flags)
+{
+    MemoryStats::Scope memory_scope(MemoryStats::Tag::Curl);
+    int running = 0;
+    curl_multi_socket_action(multi, fd, flags, &running);
+}
+
+void EventLoop::finish_transfers()
+{
+    int left = 0;
+    while (auto message = curl_multi_info_read(multi, &left)) {
+        if (message->msg != CURLMSG_DONE) {
+            continue;
+        }
+        Transfer *transfer{};
+        curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &transfer);
+        transfer->result = message->data.result;
+        curl_multi_remove_handle(multi, transfer->easy);
+        std::exchange(transfer->handle, nullptr).resume();
+    }
+}
+
+int EventLoop::socket_callback(void *, int fd, int what, void *loop, void *)
+{
+    auto &sockets = static_cast<EventLoop *>(loop)->curl_sockets;
+    if (what == CURL_POLL_REMOVE) {
+        sockets.erase(fd);
+    }
+    else {
+        sockets[fd] = what;
+    }
+    return 0;
+}
+
+int EventLoop::timer_callback(CURLM *, long timeout_ms, void *loop)
+{
+    auto &deadline = static_cast<EventLoop *>(loop)->curl_deadline;
+    if (timeout_ms < 0) {
+        deadline.reset();
+    }
+    else {
+        deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+    }
+    return 0;
+}
@@ -0,0 +1,171 @@
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include "task.hpp"
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+typedef void CURLM;
+struct curl_slist;
+
+/** Single threaded event loop for coroutines
+
+    The loop polls file descriptors, the sockets of curl transfers and
+    timers, and resumes the coroutines waiting on them. Coroutines only ever
+    run on the loop thread, so the state they share needs no locking. Other
+    threads hand work to the loop with post() and spawn(). Work still
+    pending when the loop stops is dropped, and the suspended coroutines are
+    destroyed along with their transfers
+*/
+class EventLoop
+{
+    struct Transfer;
+
+public:
+    using Clock = std::chrono::steady_clock;
+
+    class Sleep
+    {
+    public:
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle);
+
+        void await_resume() const noexcept
+        {}
+
+    private:
+        friend class EventLoop;
+        Sleep(EventLoop &loop, Clock::time_point deadline) :
+            loop(loop),
+            deadline(deadline)
+        {}
+
+        EventLoop &loop;
+        Clock::time_point deadline;
+    };
+
+    class IoReady
+    {
+    public:
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle);
+
+        void await_resume() const noexcept
+        {}
+
+    private:
+        friend class EventLoop;
+        IoReady(EventLoop &loop, int fd, short events) :
+            loop(loop),
+            fd(fd),
+            events(events)
+        {}
+
+        EventLoop &loop;
+        int fd;
+        short events;
+    };
+
+    class HttpPost
+    {
+    public:
+        HttpPost(HttpPost &&other);
+        ~HttpPost();
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle);
+        std::string await_resume();
+
+    private:
+        friend class EventLoop;
+        HttpPost(EventLoop &loop, std::unique_ptr<Transfer> transfer);
+        EventLoop &loop;
+        std::unique_ptr<Transfer> transfer;
+    };
+
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    /// Runs the loop on the calling thread until stop()
+    void run();
+    void stop();
+
+    /// Runs the function on the loop thread
+    void post(std::function<void()> func);
+    /// Starts the task on the loop thread, logging an exception escaping it
+    void spawn(Task<void> task);
+
+    Sleep sleep_for(std::chrono::milliseconds duration);
+    IoReady readable(int fd);
+    IoReady writable(int fd);
+    HttpPost http_post(
+        const std::string &url,
+        std::string body,
+        const std::vector<std::string> &headers);
+
+private:
+    struct Timer
+    {
+        Clock::time_point deadline;
+        std::coroutine_handle<> handle;
+
+        bool operator>(const Timer &other) const
+        {
+            return deadline > other.deadline;
+        }
+    };
+
+    struct Watcher
+    {
+        int fd;
+        short events;
+        std::coroutine_handle<> handle;
+    };
+
+    void wake();
+    bool run_posted();
+    void poll_once();
+    void socket_action(int fd, int flags);
+    void finish_transfers();
+
+    static int socket_callback(void *easy, int fd, int what, void *loop, void *);
+    static int timer_callback(CURLM *multi, long timeout_ms, void *loop);
+
+private:
+    CURLM *multi;
+    int wake_pipe[2];
+    std::mutex mutex;
+    std::vector<std::function<void()>> posted;
+    std::vector<Task<void>> spawned;
+    // The frames of the spawned tasks that are running
+    std::unordered_set<void *> frames;
+    bool stopped = false;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<>> timers;
+    std::vector<Watcher> watchers;
+    std::unordered_map<int, int> curl_sockets;
+    std::optional<Clock::time_point> curl_deadline;
+};
+
+#endif // EVENT_LOOP_HPP
@@ -0,0 +1,42 @@
+#include "frame_cache.hpp"
+
+void FrameCache::paint(WINDOW *win, const std::vector<std::string> &lines)
+{
+    int new_height, new_width;
+    getmaxyx(win, new_height, new_width);
+    if (new_height != height || new_width != width) {
+        height = new_height;
+        width = new_width;
+        invalidate();
+    }
+    frame.resize(height);
+    ++stats.frames;
+    static const std::string empty_line;
+    for (int row = 0; row < height; ++row) {
+        const auto &line =
+            static_cast<size_t>(row) < lines.size() ? lines[row] : empty_line;
+        auto &cached = frame[row];
+        if (cached == line) {
+            continue;
+        }
+        wmove(win, row, 0);
+        waddnstr(win, line.c_str(), line.size());
+        // A line filling the whole width has already moved the cursor down
+        if (getcury(win) == row) {
+            wclrtoeol(win);
+        }
+        cached = line;
+        ++stats.lines;
+    }
+    wnoutrefresh(win);
+}
+
+void FrameCache::invalidate()
+{
+    frame.assign(frame.size(), std::nullopt);
+}
+
+FrameCache::Stats FrameCache::get_stats() const
+{
+    return stats;
+}
@@ -0,0 +1,38 @@
+#ifndef FRAME_CACHE_HPP
+#define FRAME_CACHE_HPP
+
+#include <ncurses.h>
+#include <optional>
+#include <string>
+#include <vector>
+
+/** The class keeps the lines of the frame last painted into a window
+
+    Painting a new frame rewrites only the rows that differ from the cached
+    ones, so the terminal receives the changed lines instead of the whole
+    window. A resize or invalidate() repaints every row
+*/
+class FrameCache
+{
+public:
+    struct Stats
+    {
+        uint64_t frames = 0;
+        uint64_t lines = 0;
+    };
+
+    void paint(WINDOW *win, const std::vector<std::string> &lines);
+    void invalidate();
+
+    /// Returns the number of painted frames and rewritten lines
+    Stats get_stats() const;
+
+private:
+    // Rows with unknown content are empty optionals
+    std::vector<std::optional<std::string>> frame;
+    int height = -1;
+    int width = -1;
+    Stats stats;
+};
+
+#endif // FRAME_CACHE_HPP
@@ -0,0 +1,110 @@
+#include "latency_histogram.hpp"
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <stdexcept>
+#include <fmt/format.h>
+
+void LatencyHistogram::record(std::chrono::microseconds latency)
+{
+    const auto us = static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0));
+    buckets[bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::chrono::microseconds LatencyHistogram::percentile(double share) const
+{
+    const auto count = total.load(std::memory_order_relaxed);
+    if (!count) {
+        return {};
+    }
+    const auto rank = std::max<uint64_t>(
+        static_cast<uint64_t>(share * static_cast<double>(count) + 0.5), 1);
+    uint64_t seen = 0;
+    for (size_t idx = 0; idx < bucket_count; ++idx) {
+        seen += buckets[idx].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::chrono::microseconds(bucket_upper_bound(idx));
+        }
+    }
+    return std::chrono::microseconds(bucket_upper_bound(bucket_count - 1));
+}
+
+uint64_t LatencyHistogram::count() const
+{
+    return total.load(std::memory_order_relaxed);
+}
+
+std::vector<std::pair<std::chrono::microseconds, uint64_t>>
+LatencyHistogram::get_buckets() const
+{
+    std::vector<std::pair<std::chrono::microseconds, uint64_t>> result;
+    for (size_t idx = 0; idx < bucket_count; ++idx) {
+        if (const auto count = buckets[idx].load(std::memory_order_relaxed)) {
+            result.emplace_back(
+                std::chrono::microseconds(bucket_upper_bound(idx)), count);
+        }
+    }
+    return result;
+}
+
+size_t LatencyHistogram::bucket_index(uint64_t us)
+{
+    if (us < 16) {
+        return us;
+    }
+    const auto exponent = static_cast<size_t>(std::bit_width(us) - 1);
+    const auto idx = (exponent - 2) * 8 + ((us >> (exponent - 3)) & 7);
+    return std::min(idx, bucket_count - 1);
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(size_t idx)
+{
+    if (idx < 16) {
+        return idx;
+    }
+    const auto exponent = idx / 8 + 2;
+    return ((8 + idx % 8 + 1) << (exponent - 3)) - 1;
+}
+
+LatencyHistogram &LatencyStats::get(const std::string &name)
+{
+    std::lock_guard lock(mutex);
+    auto &histogram = histograms[name];
+    if (!histogram) {
+        histogram = std::make_unique<LatencyHistogram>();
+    }
+    return *histogram;
+}
+
+void LatencyStats::record(const std::string &name, Clock::time_point start)
+{
+    get(name).record(
+        std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start));
+}
+
+std::vector<std::string> LatencyStats::summary() const
+{
+    std::vector<std::string> result;
+    std::lock_guard lock(mutex);
+    for (const auto &[name, histogram] : histograms) {
+        result.push_back(fmt::format(
+            "{} {:.1f}/{:.1f} ms", name, histogram->percentile(0.5).count() / 1000.0,
+            histogram->percentile(0.99).count() / 1000.0));
+    }
+    return result;
+}
+
+void LatencyStats::dump(const std::string &filename) const
+{
+    std::ofstream file(filename, std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Can not open file " + filename);
+    }
+    std::lock_guard lock(mutex);
+    for (const auto &[name, histogram] : histograms) {
+        for (const auto &[upper_bound, count] : histogram->get_buckets()) {
+            file << name << '\t' << upper_bound.count() << '\t' << count << '\n';
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** Log-linear histogram of latencies in microseconds
+
+    Every power of two is split into 8 buckets, so a percentile is off by at
+    most 12.5%. Recording is lock-free and may happen on any thread
+*/
+class LatencyHistogram
+{
+public:
+    void record(std::chrono::microseconds latency);
+    /// The upper bound of the bucket holding the given share, from 0 to 1
+    std::chrono::microseconds percentile(double share) const;
+    uint64_t count() const;
+    /// The upper bounds and counts of the non-empty buckets
+    std::vector<std::pair<std::chrono::microseconds, uint64_t>> get_buckets() const;
+
+private:
+    static constexpr size_t bucket_count = 320;
+
+    static size_t bucket_index(uint64_t us);
+    static uint64_t bucket_upper_bound(size_t idx);
+
+private:
+    std::array<std::atomic<uint64_t>, bucket_count> buckets{};
+    std::atomic<uint64_t> total = 0;
+};
+
+/// Histograms by name, created on first use and kept for the whole run
+class LatencyStats
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    LatencyHistogram &get(const std::string &name);
+    void record(const std::string &name, Clock::time_point start);
+
+    /// Returns "name p50/p99 ms" entries in name order
+    std::vector<std::string> summary() const;
+    /// Writes "name, bucket upper bound in us, count" lines of tab separated values
+    void dump(const std::string &filename) const;
+
+private:
+    mutable std::mutex mutex;
+    std::map<std::string, std::unique_ptr<LatencyHistogram>> histograms;
+};
+
+#endif // LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,316 @@
+#include "lemmatizer.hpp"
+#include "tools.hpp"
+#include <algorithm>
+#include <bit>
+#include <unordered_map>
+
+struct IrregularForms
+{
+    std::string_view base;
+    std::string_view forms;
+};
+
+constexpr IrregularForms irregular_forms[] = {
+    {        "be",     "am is are was were been being"},
+    {      "have",                    "has had having"},
+    {        "do",               "does did done doing"},
+    {        "go",              "goes went gone going"},
+    {       "say",                              "said"},
+    {      "make",                              "made"},
+    {       "get",                        "got gotten"},
+    {      "know",                        "knew known"},
+    {     "think",                           "thought"},
+    {      "take",                        "took taken"},
+    {       "see",                          "saw seen"},
+    {      "come",                              "came"},
+    {      "give",                        "gave given"},
+    {      "find",                             "found"},
+    {      "tell",                              "told"},
+    {    "become",                            "became"},
+    {     "leave",                              "left"},
+    {      "feel",                              "felt"},
+    {     "bring",                           "brought"},
+    {     "begin",                       "began begun"},
+    {      "keep",                              "kept"},
+    {      "hold",                              "held"},
+    {     "write",                     "wrote written"},
+    {     "stand",                             "stood"},
+    {      "hear",                             "heard"},
+    {      "mean",                             "meant"},
+    {      "meet",                               "met"},
+    {       "run",                               "ran"},
+    {       "pay",                              "paid"},
+    {       "sit",                               "sat"},
+    {     "speak",                      "spoke spoken"},
+    {       "lie",                    "lay lain lying"},
+    {      "lead",                               "led"},
+    {      "grow",                        "grew grown"},
+    {      "lose",                              "lost"},
+    {      "fall",                       "fell fallen"},
+    {      "send",                              "sent"},
+    {     "build",                             "built"},
+    {"understand",                        "understood"},
+    {      "draw",                        "drew drawn"},
+    {     "break",                      "broke broken"},
+    {     "spend",                             "spent"},
+    {      "rise",                        "rose risen"},
+    {     "drive",                      "drove driven"},
+    {       "buy",                            "bought"},
+    {      "wear",                         "wore worn"},
+    {    "choose",                      "chose chosen"},
+    {      "seek",                            "sought"},
+    {     "throw",                      "threw thrown"},
+    {     "catch",                            "caught"},
+    {      "deal",                             "dealt"},
+    {       "win",                               "won"},
+    {    "forget",                  "forgot forgotten"},
+    {       "lay",                              "laid"},
+    {      "sell",                              "sold"},
+    {     "fight",                            "fought"},
+    {       "eat",                         "ate eaten"},
+    {     "teach",                            "taught"},
+    {     "sleep",                             "slept"},
+    {       "fly",                        "flew flown"},
+    {      "swim",                         "swam swum"},
+    {      "sing",                         "sang sung"},
+    {     "drink",                       "drank drunk"},
+    {      "ring",                         "rang rung"},
+    {     "shake",                      "shook shaken"},
+    {     "steal",                      "stole stolen"},
+    {      "hide",                        "hid hidden"},
+    {      "bite",                        "bit bitten"},
+    {    "freeze",                      "froze frozen"},
+    {      "hang",                              "hung"},
+    {      "feed",                               "fed"},
+    {       "dig",                               "dug"},
+    {     "shoot",                              "shot"},
+    {     "light",                               "lit"},
+    {      "bear",                   "bore born borne"},
+    {      "tear",                         "tore torn"},
+    {   "forgive",                  "forgave forgiven"},
+    {      "ride",                       "rode ridden"},
+    {    "strike",                            "struck"},
+    {     "swear",                       "swore sworn"},
+    {      "wake",                        "woke woken"},
+    {      "bend",                              "bent"},
+    {      "lend",                              "lent"},
+    {     "bleed",                              "bled"},
+    {      "flee",                              "fled"},
+    {     "sting",                             "stung"},
+    {     "stick",                             "stuck"},
+    {      "spin",                              "spun"},
+    {      "weep",                              "wept"},
+    {     "sweep",                             "swept"},
+    {       "man",                               "men"},
+    {     "woman",                             "women"},
+    {     "child",                          "children"},
+    {      "foot",                              "feet"},
+    {     "tooth",                             "teeth"},
+    {     "goose",                             "geese"},
+    {     "mouse",                              "mice"},
+    {    "person",                            "people"},
+    { "criterion",                          "criteria"},
+    {"phenomenon",                         "phenomena"},
+    {  "analysis",                          "analyses"},
+    {    "crisis",                            "crises"},
+    {    "thesis",                            "theses"},
+    {    "medium",                             "media"},
+    {    "fungus",                             "fungi"},
+    {   "nucleus",                            "nuclei"},
+    {      "good",                       "better best"},
+    {       "bad",                       "worse worst"},
+    {      "well",                       "better best"},
+    {       "far", "farther further farthest furthest"},
+    {    "little",                        "less least"},
+    {      "many",                         "more most"},
+    {      "much",                         "more most"},
+};
+
+static bool is_vowel(char c)
+{
+    return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u';
+}
+
+// Monosyllabic words ending in consonant-vowel-consonant double the last letter
+static bool doubles_last_consonant(std::string_view word)
+{
+    const auto size = word.size();
+    if (size < 3 || is_vowel(word[size - 1]) || is_vowel(word[size - 3]) ||
+        !is_vowel(word[size - 2]) ||
+        std::string_view("wxy").find(word.back()) != std::string_view::npos) {
+        return false;
+    }
+    return std::count_if(word.begin(), word.end(), is_vowel) == 1;
+}
+
+static bool ends_with_consonant_y(std::string_view word)
+{
+    return word.size() > 1 && word.back() == 'y' && !is_vowel(word[word.size() - 2]);
+}
+
+Lemmatizer::Lemmatizer(const std::vector<std::string> &bases)
+{
+    std::unordered_map<std::string_view, std::string_view> irregular;
+    for (const auto &item : irregular_forms) {
+        irregular.emplace(item.base, item.forms);
+    }
+    std::vector<std::pair<std::string, std::string_view>> forms;
+    for (const auto &base : bases) {
+        if (base.empty()) {
+            continue;
+        }
+        // Only the head of a phrase is inflected: "look after" -> "looking after"
+        const auto head_size = std::min(base.find(' '), base.size());
+        const auto head = std::string_view(base).substr(0, head_size);
+        const auto tail = std::string_view(base).substr(head_size);
+        forms.emplace_back(base, base);
+        for (auto &form : inflect(head)) {
+            forms.emplace_back(form.append(tail), base);
+        }
+        if (auto it = irregular.find(head); it != irregular.end()) {
+            for (auto str = it->second; !str.empty();) {
+                const auto size = std::min(str.find(' '), str.size());
+                forms.emplace_back(std::string(str.substr(0, size)).append(tail), base);
+                str.remove_prefix(std::min(size + 1, str.size()));
+            }
+        }
+    }
+    std::sort(forms.begin(), forms.end());
+    forms.erase(std::unique(forms.begin(), forms.end()), forms.end());
+
+    std::unordered_map<std::string_view, uint32_t> offsets;
+    auto intern = [this, &offsets](std::string_view str) {
+        auto [it, inserted] = offsets.emplace(str, pool.size());
+        if (inserted) {
+            pool.append(str);
+        }
+        return it->second;
+    };
+    pool.reserve(forms.size() * 8);
+    entries.reserve(forms.size());
+    size_t surfaces = 0;
+    for (const auto &[surface, base] : forms) {
+        if (surface.size() > UINT16_MAX || base.size() > UINT16_MAX) {
+            continue;
+        }
+        const auto surface_offset = intern(surface);
+        if (entries.empty() || this->surface(entries.back()) != surface) {
+            ++surfaces;
+        }
+        entries.push_back(
+            {surface_offset, intern(base), static_cast<uint16_t>(surface.size()),
+             static_cast<uint16_t>(base.size())});
+    }
+
+    slots.assign(std::bit_ceil(surfaces * 2 + 1), 0);
+    const auto mask = slots.size() - 1;
+    for (size_t idx = 0; idx < entries.size(); ++idx) {
+        const auto str = surface(entries[idx]);
+        if (idx > 0 && surface(entries[idx - 1]) == str) {
+            continue;
+        }
+        auto slot = tools::fnv1a_hash(str) & mask;
+        while (slots[slot]) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = static_cast<uint32_t>(idx + 1);
+    }
+}
+
+std::vector<std::string_view> Lemmatizer::find(std::string_view word) const
+{
+    std::vector<std::string_view> result;
+    if (slots.empty()) {
+        return result;
+    }
+    const auto mask = slots.size() - 1;
+    for (auto slot = tools::fnv1a_hash(word) & mask; slots[slot];
+         slot = (slot + 1) & mask) {
+        auto idx = slots[slot] - 1;
+        if (surface(entries[idx]) == word) {
+            for (; idx < entries.size() && surface(entries[idx]) == word; ++idx) {
+                result.push_back(base(entries[idx]));
+            }
+            break;
+        }
+    }
+    return result;
+}
+
+bool Lemmatizer::empty() const
+{
+    return entries.empty();
+}
+
+std::vector<std::string> Lemmatizer::inflect(std::string_view base)
+{
+    std::vector<std::string> result;
+    if (base.size() < 2) {
+        return result;
+    }
+    const std::string word{base};
+    const auto stem = word.substr(0, word.size() - 1);
+    const auto last = word.back();
+
+    // Plural and third person singular
+    if (word.ends_with('s') || word.ends_with('x') || word.ends_with('z') ||
+        word.ends_with("ch") || word.ends_with("sh") || word.ends_with('o')) {
+        result.push_back(word + "es");
+    }
+    if (ends_with_consonant_y(word)) {
+        result.push_back(stem + "ies");
+    }
+    else {
+        result.push_back(word + "s");
+    }
+    if (last == 'f') {
+        result.push_back(stem + "ves");
+    }
+    else if (word.ends_with("fe")) {
+        result.push_back(word.substr(0, word.size() - 2) + "ves");
+    }
+
+    // Past tense, participles and comparison
+    if (last == 'e') {
+        result.push_back(word + "d");
+        result.push_back(word + "r");
+        result.push_back(word + "st");
+        if (word.ends_with("ie")) {
+            result.push_back(word.substr(0, word.size() - 2) + "ying");
+        }
+        else if (word.ends_with("ee") || word.ends_with("ye") || word.ends_with("oe")) {
+            result.push_back(word + "ing");
+        }
+        else {
+            result.push_back(stem + "ing");
+        }
+        return result;
+    }
+    if (ends_with_consonant_y(word)) {
+        result.push_back(stem + "ied");
+        result.push_back(stem + "ier");
+        result.push_back(stem + "iest");
+        result.push_back(word + "ing");
+        return result;
+    }
+    const auto doubled = doubles_last_consonant(word) ? word + last : word;
+    result.push_back(doubled + "ed");
+    result.push_back(doubled + "er");
+    result.push_back(doubled + "est");
+    result.push_back(doubled + "ing");
+    if (doubled != word) {
+        result.push_back(word + "ed");
+        result.push_back(word + "ing");
+    }
+    return result;
+}
+
+std::string_view Lemmatizer::surface(const Entry &entry) const
+{
+    return {pool.data() + entry.surface, entry.surface_size};
+}
+
+std::string_view Lemmatizer::base(const Entry &entry) const
+{
+    return {pool.data() + entry.base, entry.base_size};
+}
@@ -0,0 +1,47 @@
+#ifndef LEMMATIZER_HPP
+#define LEMMATIZER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** Maps English inflected forms to the base words they come from
+
+    The index is built from a list of base words: regular forms are
+    generated by spelling rules and irregular ones are taken from a
+    built-in table. Every base also maps to itself. All strings live in a
+    single pool and the surface forms are looked up through an open
+    addressing hash table, so a lookup is a single hash and a short probe
+*/
+class Lemmatizer
+{
+public:
+    Lemmatizer() = default;
+    explicit Lemmatizer(const std::vector<std::string> &bases);
+
+    /// Returns the base words the given form is an inflection of
+    std::vector<std::string_view> find(std::string_view word) const;
+
+    bool empty() const;
+
+    static std::vector<std::string> inflect(std::string_view base);
+
+private:
+    struct Entry
+    {
+        uint32_t surface;
+        uint32_t base;
+        uint16_t surface_size;
+        uint16_t base_size;
+    };
+
+    std::string_view surface(const Entry &entry) const;
+    std::string_view base(const Entry &entry) const;
+
+private:
+    std::string pool;
+    std::vector<Entry> entries;
+    std::vector<uint32_t> slots;
+};
+
+#endif // LEMMATIZER_HPP
@@ -0,0 +1,92 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <fcntl.h>
+#include <st/assert_or_throw.hpp>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** The class represents a read-only memory mapped file
+
+    The mapping is shared, so several processes mapping the same file
+    use the same physical pages
+*/
+class MappedFile
+{
+public:
+    MappedFile(const std::string &filename)
+    {
+        const int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        st::assert_or_throw(fd >= 0, "Can not open file {}", filename);
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+            _size = static_cast<size_t>(info.st_size);
+            _data = ::mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (_data == MAP_FAILED) {
+            _data = nullptr;
+            _size = 0;
+            throw std::runtime_error("Can not map file " + filename);
+        }
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(MappedFile &&other) :
+        _data{other._data},
+        _size{other._size}
+    {
+        other._data = nullptr;
+        other._size = 0;
+    }
+
+    MappedFile(const MappedFile &other) = delete;
+
+    MappedFile &operator=(MappedFile &&other)
+    {
+        close();
+        _data = other._data;
+        _size = other._size;
+        other._data = nullptr;
+        other._size = 0;
+        return *this;
+    }
+
+    MappedFile &operator=(const MappedFile &other) = delete;
+
+    const char *data() const
+    {
+        return static_cast<const char *>(_data);
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    std::string_view view() const
+    {
+        return {data(), _size};
+    }
+
+    void close()
+    {
+        if (_data) {
+            ::munmap(_data, _size);
+            _data = nullptr;
+            _size = 0;
+        }
+    }
+
+private:
+    void *_data{};
+    size_t _size{};
+};
+
+#endif // MAPPED_FILE_HPP
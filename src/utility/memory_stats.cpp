@@ -0,0 +1,192 @@
+#include "memory_stats.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+struct AtomicCounters
+{
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> live;
+    std::atomic<uint64_t> peak;
+
+    void allocated(uint64_t size)
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+        const auto now = live.fetch_add(size, std::memory_order_relaxed) + size;
+        auto prev = peak.load(std::memory_order_relaxed);
+        while (now > prev &&
+               !peak.compare_exchange_weak(prev, now, std::memory_order_relaxed)) {
+        }
+    }
+
+    void freed(uint64_t size)
+    {
+        live.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    MemoryStats::Counters load() const
+    {
+        return {
+            allocations.load(std::memory_order_relaxed),
+            bytes.load(std::memory_order_relaxed),
+            live.load(std::memory_order_relaxed),
+            peak.load(std::memory_order_relaxed)};
+    }
+};
+
+// Constant initialized, so the allocations of static constructors are counted too
+constinit AtomicCounters counters[static_cast<size_t>(MemoryStats::Tag::Count)];
+constinit AtomicCounters total;
+constinit thread_local MemoryStats::Tag current_tag = MemoryStats::Tag::Other;
+
+} // namespace
+
+MemoryStats::Scope::Scope(Tag tag) :
+    previous(current_tag)
+{
+    current_tag = tag;
+}
+
+MemoryStats::Scope::~Scope()
+{
+    current_tag = previous;
+}
+
+bool MemoryStats::is_enabled()
+{
+#ifdef VB_MEMORY_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+MemoryStats::Counters MemoryStats::get(Tag tag)
+{
+    return counters[static_cast<size_t>(tag)].load();
+}
+
+MemoryStats::Counters MemoryStats::get_total()
+{
+    return total.load();
+}
+
+const char *MemoryStats::to_string(Tag tag)
+{
+    switch (tag) {
+    case Tag::Other:
+        return "other";
+    case Tag::Json:
+        return "json";
+    case Tag::Cards:
+        return "cards";
+    case Tag::Sqlite:
+        return "sqlite";
+    case Tag::Curl:
+        return "curl";
+    case Tag::Count:
+        break;
+    }
+    return "";
+}
+
+#ifdef VB_MEMORY_STATS
+
+namespace {
+
+/// Precedes every counted block, keeping the block aligned
+struct alignas(alignof(std::max_align_t)) BlockHeader
+{
+    uint64_t size;
+    MemoryStats::Tag tag;
+};
+
+void *allocate(size_t size) noexcept
+{
+    auto header =
+        static_cast<BlockHeader *>(std::malloc(sizeof(BlockHeader) + size));
+    if (!header) {
+        return nullptr;
+    }
+    header->size = size;
+    header->tag = current_tag;
+    counters[static_cast<size_t>(header->tag)].allocated(size);
+    total.allocated(size);
+    return header + 1;
+}
+
+void deallocate(void *ptr) noexcept
+{
+    if (!ptr) {
+        return;
+    }
+    auto header = static_cast<BlockHeader *>(ptr) - 1;
+    counters[static_cast<size_t>(header->tag)].freed(header->size);
+    total.freed(header->size);
+    std::free(header);
+}
+
+} // namespace
+
+void *operator new(size_t size)
+{
+    if (auto ptr = allocate(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    if (auto ptr = allocate(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    deallocate(ptr);
+}
+
+#endif // VB_MEMORY_STATS
@@ -0,0 +1,54 @@
+#ifndef MEMORY_STATS_HPP
+#define MEMORY_STATS_HPP
+
+#include <cstdint>
+
+/** Heap usage per subsystem
+
+    Built with VB_MEMORY_STATS, the global operator new records every
+    allocation under the tag of the innermost Scope on the allocating thread,
+    and operator delete returns the bytes to the tag they were allocated
+    under. Without it the counters stay zero. Aligned allocations are not
+    counted
+*/
+class MemoryStats
+{
+public:
+    enum class Tag : uint8_t {
+        Other,
+        Json,
+        Cards,
+        Sqlite,
+        Curl,
+        Count,
+    };
+
+    struct Counters
+    {
+        uint64_t allocations;
+        uint64_t bytes;
+        uint64_t live;
+        uint64_t peak;
+    };
+
+    /// Tags the allocations of the current thread while it is alive
+    class Scope
+    {
+    public:
+        explicit Scope(Tag tag);
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        const Tag previous;
+    };
+
+    static bool is_enabled();
+    static Counters get(Tag tag);
+    /// Counters of all tags, with the peak of the total live bytes
+    static Counters get_total();
+    static const char *to_string(Tag tag);
+};
+
+#endif // MEMORY_STATS_HPP
@@ -0,0 +1,311 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Blocks the producer while full and the consumer while empty, until closed
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) :
+        capacity(std::max<size_t>(capacity, 1))
+    {}
+
+    void push(T item)
+    {
+        std::unique_lock lock(mutex);
+        not_full.wait(lock, [this] {
+            return items.size() < capacity;
+        });
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+    }
+
+    /// Takes up to max_count items, waiting for one at least
+    bool pop_batch(std::vector<T> &batch, size_t max_count)
+    {
+        std::unique_lock lock(mutex);
+        not_empty.wait(lock, [this] {
+            return !items.empty() || closed;
+        });
+        batch.clear();
+        while (!items.empty() && batch.size() < max_count) {
+            batch.push_back(std::move(items.front()));
+            items.pop_front();
+        }
+        not_full.notify_all();
+        return !batch.empty();
+    }
+
+    /// Returns false once the queue is closed and drained
+    bool pop(T &item)
+    {
+        std::unique_lock lock(mutex);
+        not_empty.wait(lock, [this] {
+            return !items.empty() || closed;
+        });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+private:
+    const size_t capacity;
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::deque<T> items;
+    bool closed = false;
+};
+
+struct PipelineStageStats
+{
+    std::string name;
+    size_t workers;
+    size_t items_in;
+    size_t items_out;
+    std::chrono::microseconds busy;
+};
+
+/** The class runs items through stages connected by bounded queues
+
+    Every stage runs on its own workers concurrently with the other stages.
+    A stage returns false to drop the item. The survivors are returned in
+    the order the source emitted them, however the workers interleaved. The
+    first exception stops the work and is rethrown by run()
+*/
+template<typename T>
+class Pipeline
+{
+public:
+    using Emit = std::function<void(T)>;
+    using Source = std::function<void(const Emit &)>;
+    using Stage = std::function<bool(T &)>;
+    /// Returns whether to keep each of the items
+    using BatchStage = std::function<std::vector<bool>(std::vector<T> &)>;
+
+    explicit Pipeline(size_t queue_capacity = 64) :
+        queue_capacity(queue_capacity)
+    {}
+
+    Pipeline &add_stage(std::string name, Stage func, size_t workers = 1)
+    {
+        stages.push_back(std::make_unique<StageState>(
+            std::move(name), std::move(func), std::max<size_t>(workers, 1)));
+        return *this;
+    }
+
+    /// The stage takes the items queued so far, up to the size it returns
+    Pipeline &add_batch_stage(
+        std::string name, BatchStage func, std::function<size_t()> get_batch_size)
+    {
+        auto stage = std::make_unique<StageState>(std::move(name), nullptr, 1);
+        stage->batch_func = std::move(func);
+        stage->get_batch_size = std::move(get_batch_size);
+        stages.push_back(std::move(stage));
+        return *this;
+    }
+
+    std::vector<T> run(const Source &source)
+    {
+        std::vector<std::unique_ptr<BoundedQueue<Item>>> queues;
+        for (size_t idx = 0; idx <= stages.size(); ++idx) {
+            queues.push_back(std::make_unique<BoundedQueue<Item>>(queue_capacity));
+        }
+        std::vector<std::thread> threads;
+        for (size_t idx = 0; idx < stages.size(); ++idx) {
+            auto &stage = *stages[idx];
+            stage.running = stage.workers;
+            for (size_t worker = 0; worker < stage.workers; ++worker) {
+                threads.emplace_back([this, &stage, &in = *queues[idx],
+                                      &out = *queues[idx + 1]] {
+                    if (stage.batch_func) {
+                        run_batch_stage(stage, in, out);
+                    }
+                    else {
+                        run_stage(stage, in, out);
+                    }
+                });
+            }
+        }
+        std::vector<Item> items;
+        std::thread sink([&items, &out = *queues.back()] {
+            for (Item item; out.pop(item);) {
+                items.push_back(std::move(item));
+            }
+        });
+        size_t seq = 0;
+        try {
+            source([&](T value) {
+                if (!failed) {
+                    queues.front()->push({seq++, std::move(value)});
+                }
+            });
+        }
+        catch (...) {
+            fail(std::current_exception());
+        }
+        queues.front()->close();
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        sink.join();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        std::sort(items.begin(), items.end(), [](const auto &lhs, const auto &rhs) {
+            return lhs.seq < rhs.seq;
+        });
+        std::vector<T> result;
+        result.reserve(items.size());
+        for (auto &item : items) {
+            result.push_back(std::move(item.value));
+        }
+        return result;
+    }
+
+    std::vector<PipelineStageStats> get_stats() const
+    {
+        std::vector<PipelineStageStats> result;
+        for (const auto &stage : stages) {
+            result.push_back(
+                {stage->name, stage->workers, stage->items_in, stage->items_out,
+                 std::chrono::microseconds(stage->busy_us)});
+        }
+        return result;
+    }
+
+private:
+    struct Item
+    {
+        size_t seq;
+        T value;
+    };
+
+    struct StageState
+    {
+        StageState(std::string name, Stage func, size_t workers) :
+            name(std::move(name)),
+            func(std::move(func)),
+            workers(workers)
+        {}
+
+        const std::string name;
+        const Stage func;
+        const size_t workers;
+        BatchStage batch_func;
+        std::function<size_t()> get_batch_size;
+        std::atomic<size_t> running = 0;
+        std::atomic<size_t> items_in = 0;
+        std::atomic<size_t> items_out = 0;
+        std::atomic<int64_t> busy_us = 0;
+    };
+
+    void run_stage(StageState &stage, BoundedQueue<Item> &in, BoundedQueue<Item> &out)
+    {
+        // After a failure the items are still drained, so no producer stays blocked
+        for (Item item; in.pop(item);) {
+            if (failed) {
+                continue;
+            }
+            ++stage.items_in;
+            const auto start = std::chrono::steady_clock::now();
+            bool keep = false;
+            try {
+                keep = stage.func(item.value);
+            }
+            catch (...) {
+                fail(std::current_exception());
+            }
+            // The time blocked on a full output queue is not the stage's own
+            stage.busy_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+            if (keep) {
+                ++stage.items_out;
+                out.push(std::move(item));
+            }
+        }
+        if (--stage.running == 0) {
+            out.close();
+        }
+    }
+
+    void run_batch_stage(
+        StageState &stage, BoundedQueue<Item> &in, BoundedQueue<Item> &out)
+    {
+        std::vector<Item> batch;
+        std::vector<T> values;
+        while (in.pop_batch(batch, std::max<size_t>(stage.get_batch_size(), 1))) {
+            if (failed) {
+                continue;
+            }
+            stage.items_in += batch.size();
+            values.clear();
+            for (auto &item : batch) {
+                values.push_back(std::move(item.value));
+            }
+            const auto start = std::chrono::steady_clock::now();
+            std::vector<bool> keep;
+            try {
+                keep = stage.batch_func(values);
+            }
+            catch (...) {
+                fail(std::current_exception());
+            }
+            stage.busy_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+            for (size_t idx = 0; idx < batch.size() && idx < keep.size(); ++idx) {
+                if (keep[idx]) {
+                    ++stage.items_out;
+                    out.push({batch[idx].seq, std::move(values[idx])});
+                }
+            }
+        }
+        if (--stage.running == 0) {
+            out.close();
+        }
+    }
+
+    void fail(std::exception_ptr exception)
+    {
+        std::lock_guard lock(error_mutex);
+        if (!error) {
+            error = exception;
+        }
+        failed = true;
+    }
+
+private:
+    const size_t queue_capacity;
+    std::vector<std::unique_ptr<StageState>> stages;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    std::atomic<bool> failed = false;
+};
+
+#endif // PIPELINE_HPP
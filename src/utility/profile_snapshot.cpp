@@ -0,0 +1,140 @@
+#include "profile_snapshot.hpp"
+#include "file.hpp"
+#include "tools.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <unordered_map>
+
+constexpr char profile_snapshot_magic[4] = {'V', 'B', 'P', 'S'};
+constexpr uint32_t profile_snapshot_version = 1;
+
+ProfileSnapshot::ProfileSnapshot(const std::string &filename) :
+    file(filename)
+{
+    st::assert_or_throw(
+        file.size() >= sizeof(Header), "Profile snapshot {} is truncated", filename);
+    header = reinterpret_cast<const Header *>(file.data());
+    st::assert_or_throw(
+        std::memcmp(header->magic, profile_snapshot_magic, sizeof(header->magic)) == 0 &&
+            header->version == profile_snapshot_version,
+        "Profile snapshot {} has unsupported format", filename);
+    st::assert_or_throw(
+        header->rows_offset + header->row_count * sizeof(PackedRow) <= file.size() &&
+            header->slots_offset + header->slot_count * sizeof(uint32_t) <= file.size() &&
+            header->pool_offset + header->pool_size <= file.size() &&
+            std::has_single_bit(header->slot_count),
+        "Profile snapshot {} is corrupted", filename);
+    rows = reinterpret_cast<const PackedRow *>(file.data() + header->rows_offset);
+    slots = reinterpret_cast<const uint32_t *>(file.data() + header->slots_offset);
+    pool = file.data() + header->pool_offset;
+}
+
+void ProfileSnapshot::write(
+    const std::string &filename, uint64_t stamp, std::vector<SourceRow> source)
+{
+    std::sort(source.begin(), source.end());
+    source.erase(std::unique(source.begin(), source.end()), source.end());
+
+    std::string string_pool;
+    std::unordered_map<std::string_view, uint32_t> offsets;
+    std::vector<PackedRow> packed;
+    packed.reserve(source.size());
+    size_t base_count = 0;
+    for (size_t idx = 0; idx < source.size(); ++idx) {
+        PackedRow row{};
+        for (size_t column = 0; column < std::size(row.sizes); ++column) {
+            const auto &str = source[idx][column];
+            auto [it, inserted] = offsets.emplace(str, string_pool.size());
+            if (inserted) {
+                string_pool.append(str);
+            }
+            row.offsets[column] = it->second;
+            row.sizes[column] =
+                static_cast<uint16_t>(std::min<size_t>(str.size(), UINT16_MAX));
+        }
+        if (idx == 0 || source[idx][0] != source[idx - 1][0]) {
+            ++base_count;
+        }
+        packed.push_back(row);
+    }
+
+    std::vector<uint32_t> slot_table(std::bit_ceil(base_count * 2 + 1), 0);
+    const auto mask = slot_table.size() - 1;
+    for (size_t idx = 0; idx < source.size(); ++idx) {
+        if (idx > 0 && source[idx][0] == source[idx - 1][0]) {
+            continue;
+        }
+        auto slot = tools::fnv1a_hash(source[idx][0]) & mask;
+        while (slot_table[slot]) {
+            slot = (slot + 1) & mask;
+        }
+        slot_table[slot] = static_cast<uint32_t>(idx + 1);
+    }
+
+    Header head{};
+    std::memcpy(head.magic, profile_snapshot_magic, sizeof(head.magic));
+    head.version = profile_snapshot_version;
+    head.stamp = stamp;
+    head.row_count = static_cast<uint32_t>(packed.size());
+    head.slot_count = static_cast<uint32_t>(slot_table.size());
+    head.rows_offset = sizeof(Header);
+    head.slots_offset = head.rows_offset + packed.size() * sizeof(PackedRow);
+    head.pool_offset = head.slots_offset + slot_table.size() * sizeof(uint32_t);
+    head.pool_size = string_pool.size();
+
+    // Processes still mapping the previous snapshot keep reading the old inode
+    const auto tmp_filename = filename + ".tmp";
+    {
+        File out{tmp_filename, "w"};
+        auto write = [&out](const void *data, size_t size, size_t count) {
+            return std::fwrite(data, size, count, out) == count;
+        };
+        st::assert_or_throw(
+            write(&head, sizeof(head), 1) &&
+                write(packed.data(), sizeof(PackedRow), packed.size()) &&
+                write(slot_table.data(), sizeof(uint32_t), slot_table.size()) &&
+                write(string_pool.data(), 1, string_pool.size()),
+            "Can not write profile snapshot {}", tmp_filename);
+    }
+    std::filesystem::rename(tmp_filename, filename);
+}
+
+uint64_t ProfileSnapshot::get_stamp() const
+{
+    return header->stamp;
+}
+
+size_t ProfileSnapshot::size() const
+{
+    return header->row_count;
+}
+
+ProfileSnapshot::Row ProfileSnapshot::at(size_t idx) const
+{
+    const auto &row = rows[idx];
+    return {string(row, 0), string(row, 1), string(row, 2), string(row, 3)};
+}
+
+std::vector<ProfileSnapshot::Row> ProfileSnapshot::find(std::string_view base) const
+{
+    std::vector<Row> result;
+    const auto mask = header->slot_count - 1;
+    for (auto slot = tools::fnv1a_hash(base) & mask; slots[slot];
+         slot = (slot + 1) & mask) {
+        auto idx = slots[slot] - 1;
+        if (string(rows[idx], 0) == base) {
+            for (; idx < header->row_count && string(rows[idx], 0) == base; ++idx) {
+                result.push_back(at(idx));
+            }
+            break;
+        }
+    }
+    return result;
+}
+
+std::string_view ProfileSnapshot::string(const PackedRow &row, size_t column) const
+{
+    return {pool + row.offsets[column], row.sizes[column]};
+}
@@ -0,0 +1,71 @@
+#ifndef PROFILE_SNAPSHOT_HPP
+#define PROFILE_SNAPSHOT_HPP
+
+#include "mapped_file.hpp"
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** Read-only binary snapshot of the vocabulary profile words table
+
+    Layout: header, rows sorted by (base, level, pos), hash slots indexing
+    the first row of every base and a deduplicated string pool. The file is
+    memory mapped and all lookups return views into the mapping
+*/
+class ProfileSnapshot
+{
+public:
+    struct Row
+    {
+        std::string_view base;
+        std::string_view level;
+        std::string_view pos;
+        std::string_view gw;
+    };
+
+    using SourceRow = std::array<std::string, 4>;
+
+    explicit ProfileSnapshot(const std::string &filename);
+
+    static void write(
+        const std::string &filename, uint64_t stamp, std::vector<SourceRow> rows);
+
+    uint64_t get_stamp() const;
+    size_t size() const;
+    Row at(size_t idx) const;
+
+    /// Returns the rows of the given base word
+    std::vector<Row> find(std::string_view base) const;
+
+private:
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t stamp;
+        uint32_t row_count;
+        uint32_t slot_count;
+        uint64_t rows_offset;
+        uint64_t slots_offset;
+        uint64_t pool_offset;
+        uint64_t pool_size;
+    };
+
+    struct PackedRow
+    {
+        uint32_t offsets[4];
+        uint16_t sizes[4];
+    };
+
+    std::string_view string(const PackedRow &row, size_t column) const;
+
+private:
+    MappedFile file;
+    const Header *header{};
+    const PackedRow *rows{};
+    const uint32_t *slots{};
+    const char *pool{};
+};
+
+#endif // PROFILE_SNAPSHOT_HPP
@@ -0,0 +1,285 @@
+#include "skipped_list.hpp"
+#include "file.hpp"
+#include "tools.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <sys/file.h>
+#include <unistd.h>
+
+constexpr char skipped_list_magic[4] = {'V', 'B', 'S', 'L'};
+constexpr uint32_t skipped_list_version = 1;
+
+// About 1% false positives
+constexpr uint32_t bloom_bits_per_word = 10;
+constexpr uint32_t bloom_hashes = 7;
+
+// The log is merged once it outgrows this share of the table
+constexpr size_t compact_min_log_size = 256;
+constexpr size_t compact_log_ratio = 4;
+
+/// Positions of the Kirsch-Mitzenmacher double hashing
+static uint32_t bloom_bit(uint64_t hash, uint32_t idx, uint32_t bits)
+{
+    const auto h1 = static_cast<uint32_t>(hash);
+    const auto h2 = static_cast<uint32_t>(hash >> 32) | 1;
+    return (h1 + idx * h2) % bits;
+}
+
+/// The filter is padded to keep the offsets after it aligned
+static size_t bloom_filter_size(uint32_t bits)
+{
+    return (bits + 31) / 32 * 4;
+}
+
+/// Holds an exclusive lock shared by every process using the list
+class LogLock
+{
+public:
+    explicit LogLock(const std::string &filename) :
+        fd(::open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644))
+    {
+        st::assert_or_throw(fd >= 0, "Can not open file {}", filename);
+        while (::flock(fd, LOCK_EX) != 0) {
+            st::assert_or_throw(errno == EINTR, "Can not lock file {}", filename);
+        }
+    }
+
+    ~LogLock()
+    {
+        ::close(fd);
+    }
+
+    LogLock(const LogLock &) = delete;
+    LogLock &operator=(const LogLock &) = delete;
+
+private:
+    const int fd;
+};
+
+SkippedList::SkippedList(std::string filename_) :
+    filename(std::move(filename_)),
+    log_filename(filename + ".log"),
+    lock_filename(filename + ".lock")
+{
+    open_table();
+    read_log();
+}
+
+bool SkippedList::contains(const std::string &word) const
+{
+    if (auto it = changes.find(word); it != changes.end()) {
+        return it->second;
+    }
+    return table_contains(word);
+}
+
+void SkippedList::insert(const std::string &word)
+{
+    if (!contains(word)) {
+        append_log('+', word);
+        changes[word] = true;
+    }
+}
+
+void SkippedList::erase(const std::string &word)
+{
+    if (contains(word)) {
+        append_log('-', word);
+        changes[word] = false;
+    }
+}
+
+size_t SkippedList::size() const
+{
+    auto result = table_size();
+    for (const auto &[word, inserted] : changes) {
+        const bool in_table = table_contains(word);
+        if (inserted && !in_table) {
+            ++result;
+        }
+        else if (!inserted && in_table) {
+            --result;
+        }
+    }
+    return result;
+}
+
+void SkippedList::compact(bool force)
+{
+    const auto threshold =
+        std::max(compact_min_log_size, table_size() / compact_log_ratio);
+    if (log_size == 0 || (!force && log_size < threshold)) {
+        return;
+    }
+    // Other processes may have appended to the log or merged it meanwhile.
+    // Every change of this one is in the log already, so it is read again
+    LogLock lock(lock_filename);
+    file.reset();
+    open_table();
+    changes.clear();
+    log_size = 0;
+    read_log();
+    if (log_size == 0) {
+        return;
+    }
+    std::vector<std::string> words;
+    words.reserve(table_size() + changes.size());
+    for (size_t idx = 0; idx < table_size(); ++idx) {
+        std::string word{table_word(idx)};
+        if (auto it = changes.find(word); it == changes.end() || it->second) {
+            words.push_back(std::move(word));
+        }
+    }
+    for (const auto &[word, inserted] : changes) {
+        if (inserted) {
+            words.push_back(word);
+        }
+    }
+    file.reset();
+    write_table(filename, std::move(words));
+    std::filesystem::remove(log_filename);
+    changes.clear();
+    log_size = 0;
+    open_table();
+}
+
+bool SkippedList::table_contains(std::string_view word) const
+{
+    if (!header) {
+        return false;
+    }
+    const auto hash = tools::fnv1a_hash(word);
+    for (uint32_t idx = 0; idx < header->bloom_hashes; ++idx) {
+        const auto bit = bloom_bit(hash, idx, header->bloom_bits);
+        if (!(bloom[bit / 8] & (1 << (bit % 8)))) {
+            return false;
+        }
+    }
+    size_t first = 0, last = header->word_count;
+    while (first < last) {
+        const auto middle = first + (last - first) / 2;
+        const auto cmp = table_word(middle).compare(word);
+        if (cmp == 0) {
+            return true;
+        }
+        if (cmp < 0) {
+            first = middle + 1;
+        }
+        else {
+            last = middle;
+        }
+    }
+    return false;
+}
+
+std::string_view SkippedList::table_word(size_t idx) const
+{
+    return {pool + offsets[idx], offsets[idx + 1] - offsets[idx]};
+}
+
+size_t SkippedList::table_size() const
+{
+    return header ? header->word_count : 0;
+}
+
+void SkippedList::open_table()
+{
+    header = nullptr;
+    if (!std::filesystem::exists(filename)) {
+        return;
+    }
+    file = std::make_unique<MappedFile>(filename);
+    st::assert_or_throw(
+        file->size() >= sizeof(Header), "Skipped list {} is truncated", filename);
+    const auto head = reinterpret_cast<const Header *>(file->data());
+    st::assert_or_throw(
+        std::memcmp(head->magic, skipped_list_magic, sizeof(head->magic)) == 0 &&
+            head->version == skipped_list_version,
+        "Skipped list {} has unsupported format", filename);
+    const size_t bloom_size = bloom_filter_size(head->bloom_bits);
+    const size_t offsets_size = (head->word_count + 1) * sizeof(uint32_t);
+    st::assert_or_throw(
+        head->bloom_bits > 0 &&
+            sizeof(Header) + bloom_size + offsets_size + head->pool_size <= file->size(),
+        "Skipped list {} is corrupted", filename);
+    bloom = reinterpret_cast<const uint8_t *>(file->data() + sizeof(Header));
+    offsets =
+        reinterpret_cast<const uint32_t *>(file->data() + sizeof(Header) + bloom_size);
+    pool = reinterpret_cast<const char *>(offsets + head->word_count + 1);
+    // Every word must lie inside the pool
+    for (uint32_t idx = 0; idx <= head->word_count; ++idx) {
+        st::assert_or_throw(
+            offsets[idx] <= head->pool_size &&
+                (idx == 0 || offsets[idx - 1] <= offsets[idx]),
+            "Skipped list {} is corrupted", filename);
+    }
+    header = head;
+}
+
+void SkippedList::read_log()
+{
+    std::ifstream in(log_filename);
+    for (std::string line; std::getline(in, line); ++log_size) {
+        if (line.size() > 1) {
+            changes[line.substr(1)] = line[0] == '+';
+        }
+    }
+}
+
+void SkippedList::append_log(char operation, const std::string &word)
+{
+    // The log is opened for every change, as another process may merge it
+    LogLock lock(lock_filename);
+    std::ofstream log(log_filename, std::ios::app);
+    st::assert_or_throw(log.is_open(), "Can not open file {}", log_filename);
+    log << operation << word << std::endl;
+    ++log_size;
+}
+
+void SkippedList::write_table(const std::string &filename, std::vector<std::string> words)
+{
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+
+    Header head{};
+    std::memcpy(head.magic, skipped_list_magic, sizeof(head.magic));
+    head.version = skipped_list_version;
+    head.word_count = static_cast<uint32_t>(words.size());
+    head.bloom_bits = std::max<uint32_t>(64, head.word_count * bloom_bits_per_word);
+    head.bloom_hashes = bloom_hashes;
+
+    std::vector<uint8_t> bloom_filter(bloom_filter_size(head.bloom_bits));
+    std::vector<uint32_t> word_offsets;
+    word_offsets.reserve(words.size() + 1);
+    std::string pool;
+    for (const auto &word : words) {
+        const auto hash = tools::fnv1a_hash(word);
+        for (uint32_t idx = 0; idx < head.bloom_hashes; ++idx) {
+            const auto bit = bloom_bit(hash, idx, head.bloom_bits);
+            bloom_filter[bit / 8] |= 1 << (bit % 8);
+        }
+        word_offsets.push_back(static_cast<uint32_t>(pool.size()));
+        pool.append(word);
+    }
+    word_offsets.push_back(static_cast<uint32_t>(pool.size()));
+    head.pool_size = static_cast<uint32_t>(pool.size());
+
+    // Readers still mapping the previous table keep reading the old inode
+    const auto tmp_filename = filename + ".tmp";
+    {
+        File out{tmp_filename, "w"};
+        auto write = [&out](const void *data, size_t size, size_t count) {
+            return std::fwrite(data, size, count, out) == count;
+        };
+        st::assert_or_throw(
+            write(&head, sizeof(head), 1) &&
+                write(bloom_filter.data(), 1, bloom_filter.size()) &&
+                write(word_offsets.data(), sizeof(uint32_t), word_offsets.size()) &&
+                write(pool.data(), 1, pool.size()),
+            "Can not write skipped list {}", tmp_filename);
+    }
+    std::filesystem::rename(tmp_filename, filename);
+}
@@ -0,0 +1,66 @@
+#ifndef SKIPPED_LIST_HPP
+#define SKIPPED_LIST_HPP
+
+#include "mapped_file.hpp"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/** Persistent set of the words skipped during review
+
+    The set is a memory mapped table of sorted words behind a Bloom filter,
+    so most membership tests of absent words never touch the words. Changes
+    are appended to a log file next to the table and merged into a new table
+    by compact(). Processes sharing the list serialize appends and merges
+    with a lock file. Layout: header, Bloom filter bits, word offsets, pool
+*/
+class SkippedList
+{
+public:
+    explicit SkippedList(std::string filename);
+
+    bool contains(const std::string &word) const;
+    void insert(const std::string &word);
+    void erase(const std::string &word);
+    size_t size() const;
+
+    /// Merges the log into the table if it has grown large enough or if forced
+    void compact(bool force = false);
+
+private:
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t word_count;
+        uint32_t bloom_bits;
+        uint32_t bloom_hashes;
+        uint32_t pool_size;
+    };
+
+    bool table_contains(std::string_view word) const;
+    std::string_view table_word(size_t idx) const;
+    void open_table();
+    void read_log();
+    void append_log(char operation, const std::string &word);
+    size_t table_size() const;
+
+    static void write_table(const std::string &filename, std::vector<std::string> words);
+
+private:
+    const std::string filename;
+    const std::string log_filename;
+    const std::string lock_filename;
+    std::unique_ptr<MappedFile> file;
+    const Header *header{};
+    const uint8_t *bloom{};
+    const uint32_t *offsets{};
+    const char *pool{};
+    // Logged changes not merged into the table yet: true for inserted words
+    std::unordered_map<std::string, bool> changes;
+    size_t log_size = 0;
+};
+
+#endif // SKIPPED_LIST_HPP
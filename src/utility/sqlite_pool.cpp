@@ -0,0 +1,151 @@
+#include "sqlite_pool.hpp"
+#include <atomic>
+#include <sqlite3.h>
+#include <st/assert_or_throw.hpp>
+
+static std::atomic<uint64_t> last_pool_id{0};
+
+// The live pools, so an exiting thread only returns connections to those
+static std::mutex pools_mutex;
+static std::unordered_map<uint64_t, SqlitePool *> pools;
+
+thread_local SqlitePool::ThreadConnections SqlitePool::thread_connections;
+
+SqlitePool::ThreadConnections::~ThreadConnections()
+{
+    std::lock_guard lock(pools_mutex);
+    for (const auto &[id, connection] : connections) {
+        if (auto it = pools.find(id); it != pools.end()) {
+            it->second->release(connection);
+        }
+    }
+}
+
+SqlitePool::SqlitePool(std::string filepath) :
+    filepath(std::move(filepath)),
+    id(++last_pool_id)
+{
+    std::lock_guard lock(pools_mutex);
+    pools.emplace(id, this);
+}
+
+SqlitePool::~SqlitePool()
+{
+    std::lock_guard lock(pools_mutex);
+    pools.erase(id);
+}
+
+SqlitePool::Query &SqlitePool::query(const std::string &sql)
+{
+    auto &connection = get_connection();
+    auto [it, inserted] = connection.statements.try_emplace(sql, connection.db, sql);
+    if (!inserted) {
+        it->second.reset();
+    }
+    return it->second;
+}
+
+SqlitePool::Connection &SqlitePool::get_connection()
+{
+    auto &connection = thread_connections.connections[id];
+    if (connection) {
+        return *connection;
+    }
+    {
+        std::lock_guard lock(mutex);
+        if (!idle_connections.empty()) {
+            connection = idle_connections.back();
+            idle_connections.pop_back();
+            return *connection;
+        }
+    }
+    auto new_connection = std::make_unique<Connection>(filepath);
+    std::lock_guard lock(mutex);
+    connections.push_back(std::move(new_connection));
+    connection = connections.back().get();
+    return *connection;
+}
+
+void SqlitePool::release(Connection *connection)
+{
+    std::lock_guard lock(mutex);
+    idle_connections.push_back(connection);
+}
+
+SqlitePool::Connection::Connection(const std::string &filepath)
+{
+    const auto rc = sqlite3_open_v2(filepath.c_str(), &db, SQLITE_OPEN_READONLY, nullptr);
+    if (rc != SQLITE_OK) {
+        sqlite3_close(db);
+        throw std::runtime_error(
+            "Can not open database " + filepath + ": " + sqlite3_errstr(rc));
+    }
+}
+
+SqlitePool::Connection::~Connection()
+{
+    // Statements must be finalized before their connection is closed
+    statements.clear();
+    sqlite3_close(db);
+}
+
+SqlitePool::Query::Query(sqlite3 *db, const std::string &sql) :
+    db(db)
+{
+    st::assert_or_throw(
+        sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK,
+        "Can not prepare query: {}", sqlite3_errmsg(db));
+}
+
+SqlitePool::Query::~Query()
+{
+    sqlite3_finalize(stmt);
+}
+
+void SqlitePool::Query::bind(const std::string &value)
+{
+    st::assert_or_throw(
+        sqlite3_bind_text(stmt, ++bind_idx, value.data(), value.size(),
+                          SQLITE_TRANSIENT) == SQLITE_OK,
+        "Can not bind a query parameter: {}", sqlite3_errmsg(db));
+}
+
+void SqlitePool::Query::bind(int64_t value)
+{
+    st::assert_or_throw(
+        sqlite3_bind_int64(stmt, ++bind_idx, value) == SQLITE_OK,
+        "Can not bind a query parameter: {}", sqlite3_errmsg(db));
+}
+
+bool SqlitePool::Query::step()
+{
+    column = 0;
+    const auto rc = sqlite3_step(stmt);
+    st::assert_or_throw(
+        rc == SQLITE_ROW || rc == SQLITE_DONE, "Can not run query: {}",
+        sqlite3_errmsg(db));
+    return rc == SQLITE_ROW;
+}
+
+std::string SqlitePool::Query::get_string()
+{
+    const auto idx = column++;
+    const auto text = sqlite3_column_text(stmt, idx);
+    return text ? std::string(reinterpret_cast<const char *>(text),
+                              sqlite3_column_bytes(stmt, idx))
+                : std::string();
+}
+
+int64_t SqlitePool::Query::get_int64()
+{
+    return sqlite3_column_int64(stmt, column++);
+}
+
+void SqlitePool::Query::reset()
+{
+    // Resetting a statement keeps its bindings
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    bind_idx = 0;
+    column = 0;
+}
@@ -0,0 +1,92 @@
+#ifndef SQLITE_POOL_HPP
+#define SQLITE_POOL_HPP
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** Read-only connections to a SQLite database, one per calling thread
+
+    A connection can't be shared between threads, so every thread gets its
+    own one on first use. Each connection keeps its prepared statements
+    keyed by the SQL text and hands them out reset for the next binding.
+    A thread hands its connection back to the pool on exit, so short-lived
+    workers reuse the connections and statements of the finished ones. All
+    connections are owned by the pool and closed with it.
+
+    Statements are kept on the raw SQLite handles, as resetting them for
+    reuse is not part of the SqliteDatabase wrapper
+*/
+struct sqlite3;
+struct sqlite3_stmt;
+
+class SqlitePool
+{
+public:
+    /// A prepared statement, read the same way as SqliteDatabase queries
+    class Query
+    {
+    public:
+        Query(sqlite3 *db, const std::string &sql);
+        ~Query();
+        Query(const Query &) = delete;
+        Query &operator=(const Query &) = delete;
+
+        void bind(const std::string &value);
+        void bind(int64_t value);
+        bool step();
+        std::string get_string();
+        int64_t get_int64();
+        /// Rewinds the statement and clears its bindings
+        void reset();
+
+    private:
+        sqlite3 *const db;
+        sqlite3_stmt *stmt = nullptr;
+        int bind_idx = 0;
+        int column = 0;
+    };
+
+    explicit SqlitePool(std::string filepath);
+    ~SqlitePool();
+    SqlitePool(const SqlitePool &) = delete;
+    SqlitePool &operator=(const SqlitePool &) = delete;
+
+    /// Returns the calling thread's prepared statement for the SQL
+    Query &query(const std::string &sql);
+
+private:
+    struct Connection
+    {
+        explicit Connection(const std::string &filepath);
+        ~Connection();
+
+        sqlite3 *db = nullptr;
+        std::unordered_map<std::string, Query> statements;
+    };
+
+    /// The connections of a thread, returned to their pools when it exits
+    struct ThreadConnections
+    {
+        ~ThreadConnections();
+
+        std::unordered_map<uint64_t, Connection *> connections;
+    };
+
+    Connection &get_connection();
+    void release(Connection *connection);
+
+private:
+    const std::string filepath;
+    const uint64_t id;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Connection>> connections;
+    std::vector<Connection *> idle_connections;
+
+    // Pools are identified by id rather than address, which can be reused
+    static thread_local ThreadConnections thread_connections;
+};
+
+#endif // SQLITE_POOL_HPP
@@ -0,0 +1,215 @@
+#ifndef TASK_HPP
+#define TASK_HPP
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+/** Lazily started coroutine producing a value of type T
+
+    The coroutine starts when the task is awaited and resumes the awaiting
+    coroutine when it finishes, so a chain of awaits runs without queueing.
+    An exception escaping the coroutine is rethrown to the awaiting one
+*/
+template<typename T = void>
+class Task;
+
+namespace detail {
+
+template<typename Promise>
+struct FinalAwaiter
+{
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+    {
+        if (auto continuation = handle.promise().continuation) {
+            return continuation;
+        }
+        return std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept
+    {}
+};
+
+struct PromiseBase
+{
+    std::suspend_always initial_suspend() const noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception() noexcept
+    {
+        error = std::current_exception();
+    }
+
+    void rethrow_if_failed() const
+    {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+};
+
+} // namespace detail
+
+template<typename T>
+class Task
+{
+public:
+    struct promise_type : detail::PromiseBase
+    {
+        Task get_return_object()
+        {
+            return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        detail::FinalAwaiter<promise_type> final_suspend() const noexcept
+        {
+            return {};
+        }
+
+        template<typename U>
+        void return_value(U &&result)
+        {
+            value.emplace(std::forward<U>(result));
+        }
+
+        T take()
+        {
+            rethrow_if_failed();
+            return std::move(*value);
+        }
+
+        std::optional<T> value;
+    };
+
+    Task(Task &&other) noexcept :
+        handle(std::exchange(other.handle, nullptr))
+    {}
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    T await_resume()
+    {
+        return handle.promise().take();
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) :
+        handle(handle)
+    {}
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+template<>
+class Task<void>
+{
+public:
+    struct promise_type : detail::PromiseBase
+    {
+        Task get_return_object()
+        {
+            return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        detail::FinalAwaiter<promise_type> final_suspend() const noexcept
+        {
+            return {};
+        }
+
+        void return_void() const noexcept
+        {}
+
+        void take() const
+        {
+            rethrow_if_failed();
+        }
+    };
+
+    Task(Task &&other) noexcept :
+        handle(std::exchange(other.handle, nullptr))
+    {}
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    void await_resume()
+    {
+        handle.promise().take();
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) :
+        handle(handle)
+    {}
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+#endif // TASK_HPP
@@ -1,5 +1,24 @@
 #include "tools.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <filesystem>
+#include <st/assert_or_throw.hpp>
 #include <st/string_functions.hpp>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#elif defined(__APPLE__)
+#include <copyfile.h>
+#endif
+
+// Covers the SQLite header with its file change counter
+constexpr size_t fingerprint_page_size = 4096;
+
+// Committed transactions may still sit in the write-ahead log until a checkpoint
+constexpr std::array<const char *, 2> database_suffixes{"-wal", ""};
+// A rollback journal belongs to an unfinished transaction and must not be replayed
+constexpr std::array<const char *, 2> stale_suffixes{"-journal", "-shm"};
 
 std::string tools::weekday_to_string(uint32_t day)
 {
@@ -45,3 +64,126 @@ std::string tools::clear_string(const std::string &string, bool &changed)
     }
     return str;
 }
+
+std::string tools::normalize_word(const std::string &word)
+{
+    auto result = clear_string(word);
+    std::transform(result.begin(), result.end(), result.begin(), [](uint8_t c) {
+        return std::tolower(c);
+    });
+    return result;
+}
+
+std::array<uint64_t, 3> tools::file_fingerprint(const std::string &filename)
+{
+    const auto size = std::filesystem::file_size(filename);
+    const auto mtime =
+        std::filesystem::last_write_time(filename).time_since_epoch().count();
+    const int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    st::assert_or_throw(fd >= 0, "Can not open file {}", filename);
+    std::string pages(std::min<uint64_t>(size, 2 * fingerprint_page_size), '\0');
+    const auto head = std::min<uint64_t>(size, fingerprint_page_size);
+    const auto tail = pages.size() - head;
+    const bool ok = ::pread(fd, pages.data(), head, 0) == static_cast<ssize_t>(head) &&
+                    ::pread(fd, pages.data() + head, tail, size - tail) ==
+                        static_cast<ssize_t>(tail);
+    ::close(fd);
+    st::assert_or_throw(ok, "Can not read file {}", filename);
+    return {size, static_cast<uint64_t>(mtime), fnv1a_hash(pages)};
+}
+
+void tools::copy_file(const std::string &source, const std::string &target)
+{
+    // Readers of the previous copy keep their inode until they close it
+    const auto tmp_target = target + ".tmp";
+#if defined(__linux__) || defined(__APPLE__)
+    const int in = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    st::assert_or_throw(in >= 0, "Can not open file {}", source);
+    const int out =
+        ::open(tmp_target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        ::close(in);
+        throw std::runtime_error("Can not open file " + tmp_target);
+    }
+#ifdef __linux__
+    struct stat info;
+    bool ok = ::fstat(in, &info) == 0;
+    off_t remaining = ok ? info.st_size : 0;
+    // copy_file_range fails across filesystems on newer kernels, sendfile does not
+    bool use_sendfile = false;
+    while (ok && remaining > 0) {
+        const ssize_t copied =
+            use_sendfile ? ::sendfile(out, in, nullptr, remaining)
+                         : ::copy_file_range(in, nullptr, out, nullptr, remaining, 0);
+        if (copied < 0 && !use_sendfile &&
+            (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+             errno == EOPNOTSUPP)) {
+            use_sendfile = true;
+            continue;
+        }
+        ok = copied > 0;
+        remaining -= copied;
+    }
+#else
+    // Copies in blocks of the file system's preferred size, FAT volumes can't clone
+    const bool ok = ::fcopyfile(in, out, nullptr, COPYFILE_DATA) == 0;
+#endif
+    ::close(in);
+    ::close(out);
+    if (!ok) {
+        std::filesystem::remove(tmp_target);
+        throw std::runtime_error("Can not copy file " + source);
+    }
+#else
+    std::filesystem::copy_file(
+        source, tmp_target, std::filesystem::copy_options::overwrite_existing);
+#endif
+    std::filesystem::rename(tmp_target, target);
+}
+
+std::vector<std::array<uint64_t, 3>> tools::database_fingerprint(
+    const std::string &filename)
+{
+    std::vector<std::array<uint64_t, 3>> result;
+    for (const auto suffix : database_suffixes) {
+        if (const auto path = filename + suffix; std::filesystem::exists(path)) {
+            result.push_back(file_fingerprint(path));
+        }
+        else {
+            result.push_back({});
+        }
+    }
+    return result;
+}
+
+void tools::copy_database(const std::string &source, const std::string &target)
+{
+    // Neither the index nor a journal of the previous copy matches the new log
+    for (const auto suffix : stale_suffixes) {
+        std::filesystem::remove(target + suffix);
+    }
+    for (const auto suffix : database_suffixes) {
+        if (std::filesystem::exists(source + suffix)) {
+            copy_file(source + suffix, target + suffix);
+        }
+        else {
+            std::filesystem::remove(target + suffix);
+        }
+    }
+}
+
+void tools::move_database(const std::string &source, const std::string &target)
+{
+    for (const auto suffix : stale_suffixes) {
+        std::filesystem::remove(source + suffix);
+        std::filesystem::remove(target + suffix);
+    }
+    for (const auto suffix : database_suffixes) {
+        if (std::filesystem::exists(source + suffix)) {
+            std::filesystem::rename(source + suffix, target + suffix);
+        }
+        else {
+            std::filesystem::remove(target + suffix);
+        }
+    }
+}
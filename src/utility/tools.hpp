@@ -1,7 +1,10 @@
 #ifndef TOOLS_HPP
 #define TOOLS_HPP
 
+#include <array>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace tools {
 
@@ -10,6 +13,29 @@ std::string weekday_to_string(uint32_t day);
 
 std::string clear_string(const std::string &string);
 std::string clear_string(const std::string &string, bool &changed);
+std::string normalize_word(const std::string &word);
+
+/// Size, modification time and a hash of the first and last pages of the file
+std::array<uint64_t, 3> file_fingerprint(const std::string &filename);
+
+/// Copies the file in the kernel where possible and replaces the target atomically
+void copy_file(const std::string &source, const std::string &target);
+
+/// Fingerprints of an SQLite database and of its write-ahead log
+std::vector<std::array<uint64_t, 3>> database_fingerprint(const std::string &filename);
+
+/// Copies an SQLite database with its write-ahead log, so the copy sees every commit
+void copy_database(const std::string &source, const std::string &target);
+void move_database(const std::string &source, const std::string &target);
+
+inline uint64_t fnv1a_hash(std::string_view str)
+{
+    uint64_t result = 14695981039346656037ull;
+    for (const uint8_t c : str) {
+        result = (result ^ c) * 1099511628211ull;
+    }
+    return result;
+}
 
 template<template<class...> class Container = std::vector, class T>
 auto split(const std::basic_string<T> &str, const T *delimiter)
@@ -0,0 +1,123 @@
+#include "ui_queue.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <st/assert_or_throw.hpp>
+#include <st/logger.hpp>
+#include <unistd.h>
+
+static bool write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        const auto written = ::write(fd, data, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+UiQueue::UiQueue() :
+    terminal(::dup(STDIN_FILENO))
+{
+    st::assert_or_throw(terminal >= 0, "Can not duplicate stdin");
+    st::assert_or_throw(::pipe(input_pipe) == 0, "Can not create a pipe");
+    st::assert_or_throw(::pipe(wake_pipe) == 0, "Can not create a pipe");
+    for (const int fd : wake_pipe) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    for (const int fd :
+         {terminal, input_pipe[0], input_pipe[1], wake_pipe[0], wake_pipe[1]}) {
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    // The terminal modes stay on stdout's tty, ncurses only reads the pipe
+    ::dup2(input_pipe[0], STDIN_FILENO);
+    forwarder = std::thread(&UiQueue::forward, this);
+}
+
+UiQueue::~UiQueue()
+{
+    ::close(wake_pipe[1]);
+    forwarder.join();
+    ::dup2(terminal, STDIN_FILENO);
+    ::close(terminal);
+    ::close(input_pipe[0]);
+    ::close(wake_pipe[0]);
+}
+
+void UiQueue::post(Func func)
+{
+    {
+        std::lock_guard lock(mutex);
+        funcs.push_back(std::move(func));
+    }
+    request_paint();
+}
+
+void UiQueue::request_paint() const
+{
+    // A full pipe already holds a wake-up
+    const char byte = 0;
+    [[maybe_unused]] auto res = ::write(wake_pipe[1], &byte, 1);
+}
+
+void UiQueue::run_posted()
+{
+    std::vector<Func> posted;
+    {
+        std::lock_guard lock(mutex);
+        posted.swap(funcs);
+    }
+    for (auto &func : posted) {
+        try {
+            func();
+        }
+        catch (const std::exception &e) {
+            st::log::error("Error from a posted task: {}", e.what());
+        }
+    }
+}
+
+void UiQueue::forward()
+{
+    // The only writer of the input pipe, so escape sequences are never split
+    pollfd fds[] = {
+        {terminal,     POLLIN, 0},
+        {wake_pipe[0], POLLIN, 0},
+    };
+    char buffer[256];
+    while (true) {
+        if (::poll(fds, std::size(fds), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents) {
+            ssize_t size;
+            while ((size = ::read(wake_pipe[0], buffer, sizeof(buffer))) > 0) {
+            }
+            if (size == 0) { // closed by the destructor
+                break;
+            }
+            const char key = static_cast<char>(wake_key);
+            write_all(input_pipe[1], &key, 1);
+        }
+        if (fds[0].revents) {
+            const auto size = ::read(terminal, buffer, sizeof(buffer));
+            if (size < 0 && errno == EINTR) {
+                continue;
+            }
+            if (size <= 0 || !write_all(input_pipe[1], buffer, size)) {
+                break;
+            }
+        }
+    }
+    // ncurses sees the end of input as it would on the terminal
+    ::close(input_pipe[1]);
+}
@@ -0,0 +1,47 @@
+#ifndef UI_QUEUE_HPP
+#define UI_QUEUE_HPP
+
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** The class runs work posted from other threads on the terminal thread
+
+    The terminal thread blocks in ncurses' read of stdin, so stdin is
+    replaced with a pipe fed by a forwarding thread. The forwarder copies
+    the terminal input and writes wake_key whenever work is posted, and
+    the window that receives the key calls run_posted() and repaints
+*/
+class UiQueue
+{
+public:
+    using Func = std::function<void()>;
+
+    /// ASCII file separator, Ctrl-\ sends SIGQUIT instead in cbreak mode
+    static constexpr char32_t wake_key = 0x1c;
+
+    /// Must be created on the terminal thread once the screen is set up
+    UiQueue();
+    ~UiQueue();
+    UiQueue(const UiQueue &) = delete;
+    UiQueue &operator=(const UiQueue &) = delete;
+
+    void post(Func func);
+    /// Wakes the terminal thread for a repaint only
+    void request_paint() const;
+    void run_posted();
+
+private:
+    void forward();
+
+private:
+    int terminal;
+    int input_pipe[2];
+    int wake_pipe[2];
+    std::mutex mutex;
+    std::vector<Func> funcs;
+    std::thread forwarder;
+};
+
+#endif // UI_QUEUE_HPP
@@ -0,0 +1,85 @@
+#include "write_behind_queue.hpp"
+#include "card.hpp"
+#include <algorithm>
+
+WriteBehindQueue::WriteBehindQueue(Flush flush, size_t max_batch_size) :
+    flush(std::move(flush)),
+    max_batch_size(max_batch_size),
+    worker(&WriteBehindQueue::run, this)
+{}
+
+WriteBehindQueue::~WriteBehindQueue()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopped = true;
+    }
+    cv.notify_one();
+    worker.join();
+}
+
+void WriteBehindQueue::push(Card &card, Operation operation, Callback flushed)
+{
+    card.set_sync_status(Card::SyncStatus::Pending);
+    {
+        std::lock_guard lock(mutex);
+        if (auto it = queued.find(&card); it != queued.end()) {
+            auto &item = queue[it->second];
+            item.operations |= operation;
+            if (flushed) {
+                item.callbacks.push_back(std::move(flushed));
+            }
+            return;
+        }
+        queued.emplace(&card, queue.size());
+        queue.push_back({&card, operation, {}});
+        if (flushed) {
+            queue.back().callbacks.push_back(std::move(flushed));
+        }
+    }
+    cv.notify_one();
+}
+
+void WriteBehindQueue::wait_idle()
+{
+    std::unique_lock lock(mutex);
+    idle_cv.wait(lock, [this] { return queue.empty() && !flushing; });
+}
+
+void WriteBehindQueue::run()
+{
+    std::unique_lock lock(mutex);
+    while (true) {
+        cv.wait(lock, [this] { return stopped || !queue.empty(); });
+        if (queue.empty()) {
+            return;
+        }
+        const auto size = std::min(queue.size(), max_batch_size);
+        std::vector<Item> batch(
+            std::make_move_iterator(queue.begin()),
+            std::make_move_iterator(queue.begin() + size));
+        queue.erase(queue.begin(), queue.begin() + size);
+        queued.clear();
+        for (size_t idx = 0; idx < queue.size(); ++idx) {
+            queued.emplace(queue[idx].card, idx);
+        }
+        flushing = true;
+        lock.unlock();
+        try {
+            flush(batch);
+        }
+        catch (const std::exception &) {
+            for (const auto &item : batch) {
+                item.card->set_sync_status(Card::SyncStatus::Failed);
+            }
+        }
+        for (const auto &item : batch) {
+            for (const auto &callback : item.callbacks) {
+                callback();
+            }
+        }
+        lock.lock();
+        flushing = false;
+        idle_cv.notify_all();
+    }
+}
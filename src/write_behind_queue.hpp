@@ -0,0 +1,67 @@
+#ifndef WRITE_BEHIND_QUEUE_HPP
+#define WRITE_BEHIND_QUEUE_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class Card;
+
+/** The class collects card writes and flushes them in batches on a worker
+
+    Writes to a card that is still queued are merged into one item, so an
+    add followed by several updates costs a single flush entry. The flush
+    reads the card fields at flush time and sets the card sync status. The
+    callbacks given with the writes run once their item is flushed, whether
+    it was committed or failed. Queued writes are flushed before the queue
+    is destroyed
+*/
+class WriteBehindQueue
+{
+public:
+    enum Operation : uint8_t {
+        Add = 1 << 0,
+        Update = 1 << 1,
+    };
+
+    using Callback = std::function<void()>;
+
+    struct Item
+    {
+        Card *card;
+        uint8_t operations;
+        std::vector<Callback> callbacks;
+    };
+
+    using Flush = std::function<void(const std::vector<Item> &batch)>;
+
+    WriteBehindQueue(Flush flush, size_t max_batch_size);
+    ~WriteBehindQueue();
+    WriteBehindQueue(const WriteBehindQueue &) = delete;
+    WriteBehindQueue &operator=(const WriteBehindQueue &) = delete;
+
+    void push(Card &card, Operation operation, Callback flushed = {});
+
+    /// Blocks until every queued write has been flushed
+    void wait_idle();
+
+private:
+    void run();
+
+private:
+    const Flush flush;
+    const size_t max_batch_size;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::condition_variable idle_cv;
+    std::vector<Item> queue;
+    std::unordered_map<Card *, size_t> queued;
+    bool flushing = false;
+    bool stopped = false;
+    std::thread worker;
+};
+
+#endif // WRITE_BEHIND_QUEUE_HPP
@@ -1,6 +1,692 @@
+#include <atomic>
+#include <card_queue.hpp>
 #include <catch2/catch.hpp>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <thread>
+#include <unistd.h>
+#include <sqlite3.h>
+#include <utility/anki_client.hpp>
+#include <utility/anki_collection.hpp>
+#include <utility/anki_tape.hpp>
+#include <utility/batch_controller.hpp>
+#include <utility/bk_tree.hpp>
+#include <utility/clippings_parser.hpp>
+#include <utility/debouncer.hpp>
+#include <utility/event_loop.hpp>
+#include <utility/latency_histogram.hpp>
+#include <utility/lemmatizer.hpp>
+#include <utility/memory_stats.hpp>
+#include <utility/pipeline.hpp>
+#include <utility/profile_snapshot.hpp>
+#include <utility/skipped_list.hpp>
+#include <utility/tools.hpp>
+#include <write_behind_queue.hpp>
 
 TEST_CASE("the first test")
 {
     REQUIRE(true);
 }
+
+TEST_CASE("clippings parser")
+{
+    constexpr std::string_view data =
+        "\xEF\xBB\xBFThe Hobbit (J. R. R. Tolkien)\r\n"
+        "- Your Highlight on page 5 | Location 70-70 | Added on Monday\r\n"
+        "\r\n"
+        "burglar\r\n"
+        "==========\r\n"
+        "The Hobbit (J. R. R. Tolkien)\r\n"
+        "- Your Bookmark on page 7 | Location 90 | Added on Monday\r\n"
+        "\r\n"
+        "\r\n"
+        "==========\r\n"
+        "Dune (Frank Herbert)\r\n"
+        "- Your Note on page 9 | Location 12 | Added on Tuesday\r\n"
+        "\r\n"
+        "my note\r\n"
+        "==========\r\n"
+        "Dune (Frank Herbert)\r\n"
+        "- Your Highlight on page 9 | Location 12-13 | Added on Tuesday\r\n"
+        "\r\n"
+        "spice must flow\r\n"
+        "==========\r\n"
+        "Der Hobbit (J. R. R. Tolkien)\r\n"
+        "- Ihre Notiz auf Seite 3 | Position 40 | Hinzugefügt am 2023-01-02\r\n"
+        "\r\n"
+        "meine Notiz\r\n"
+        "==========\r\n"
+        "Der Hobbit (J. R. R. Tolkien)\r\n"
+        "- Ihre Markierung auf Seite 3 | Position 41-41 | Hinzugefügt am 2023-01-02\r\n"
+        "\r\n"
+        "Meisterdieb\r\n"
+        "==========\r\n";
+
+    ClippingsParser parser{data};
+    ClippingsParser::Clipping clipping;
+    REQUIRE(parser.next(clipping));
+    REQUIRE(clipping.book == "The Hobbit (J. R. R. Tolkien)");
+    REQUIRE(clipping.text == "burglar");
+    REQUIRE(parser.next(clipping));
+    REQUIRE(clipping.book == "Dune (Frank Herbert)");
+    REQUIRE(clipping.text == "spice must flow");
+    REQUIRE(parser.next(clipping));
+    REQUIRE(clipping.book == "Der Hobbit (J. R. R. Tolkien)");
+    REQUIRE(clipping.text == "Meisterdieb");
+    REQUIRE_FALSE(parser.next(clipping));
+}
+
+TEST_CASE("lemmatizer")
+{
+    const Lemmatizer lemmatizer{
+        {"run", "goose", "study", "stop", "leaf", "leave", "make", "look after"}
+    };
+    using list = std::vector<std::string_view>;
+    REQUIRE(lemmatizer.find("running") == list{"run"});
+    REQUIRE(lemmatizer.find("ran") == list{"run"});
+    REQUIRE(lemmatizer.find("geese") == list{"goose"});
+    REQUIRE(lemmatizer.find("studies") == list{"study"});
+    REQUIRE(lemmatizer.find("stopped") == list{"stop"});
+    REQUIRE(lemmatizer.find("leaves") == list{"leaf", "leave"});
+    REQUIRE(lemmatizer.find("making") == list{"make"});
+    REQUIRE(lemmatizer.find("looking after") == list{"look after"});
+    REQUIRE(lemmatizer.find("make") == list{"make"});
+    REQUIRE(lemmatizer.find("walking").empty());
+}
+
+TEST_CASE("bk tree")
+{
+    REQUIRE(BkTree::distance("kitten", "sitting") == 3);
+    REQUIRE(BkTree::distance("", "abc") == 3);
+    REQUIRE(BkTree::distance("same", "same") == 0);
+
+    const BkTree tree{
+        {"receive", "recipe", "deceive", "believe", "relieve", "receipt"}
+    };
+    const auto matches = tree.find("recieve", 2);
+    REQUIRE(matches.size() == 4);
+    REQUIRE(matches[0].word == "relieve");
+    REQUIRE(matches[0].distance == 1);
+    REQUIRE(matches[1].word == "believe");
+    REQUIRE(matches[2].word == "receive");
+    REQUIRE(matches[3].word == "recipe");
+    REQUIRE(matches[3].distance == 2);
+    REQUIRE(tree.find("zzz", 1).empty());
+
+    const auto filename = std::filesystem::temp_directory_path().append("test.bktree");
+    tree.save(filename, 42);
+    BkTree loaded;
+    REQUIRE_FALSE(loaded.load(filename, 43));
+    REQUIRE(loaded.load(filename, 42));
+    REQUIRE(loaded.find("recieve", 2).size() == 4);
+    {
+        // Point the children of the root back at the root
+        std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(32 + 8);
+        const uint32_t children_begin = 0;
+        file.write(reinterpret_cast<const char *>(&children_begin), sizeof(uint32_t));
+    }
+    BkTree corrupted;
+    REQUIRE_FALSE(corrupted.load(filename, 42));
+    REQUIRE(corrupted.empty());
+    tree.save(filename, 42);
+    std::filesystem::resize_file(filename, std::filesystem::file_size(filename) - 1);
+    BkTree truncated;
+    REQUIRE_FALSE(truncated.load(filename, 42));
+    REQUIRE(truncated.empty());
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("profile snapshot")
+{
+    const auto filename =
+        std::filesystem::temp_directory_path().append("test_profile.snapshot");
+    ProfileSnapshot::write(
+        filename, 42,
+        {
+            {"run", "A1", "verb", "move fast"},
+            {"go", "A1", "verb", "move"},
+            {"run", "B1", "noun", "exercise"},
+            {"abandon", "B2", "verb", "leave"},
+    });
+    const ProfileSnapshot snapshot{filename};
+    REQUIRE(snapshot.get_stamp() == 42);
+    REQUIRE(snapshot.size() == 4);
+    REQUIRE(snapshot.at(0).base == "abandon");
+    const auto rows = snapshot.find("run");
+    REQUIRE(rows.size() == 2);
+    REQUIRE(rows[0].level == "A1");
+    REQUIRE(rows[0].gw == "move fast");
+    REQUIRE(rows[1].pos == "noun");
+    REQUIRE(snapshot.find("walk").empty());
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("database copy")
+{
+    const auto path = std::filesystem::temp_directory_path();
+    const auto source = path / "test_source.db";
+    const auto target = path / "test_target.db";
+    const auto moved = path / "test_moved.db";
+    const auto write = [](const std::string &filename, const std::string &data) {
+        std::ofstream(filename) << data;
+    };
+    const auto read = [](const std::string &filename) {
+        std::ifstream file(filename);
+        return std::string(std::istreambuf_iterator<char>(file), {});
+    };
+    write(source, "database");
+    write(source.string() + "-wal", "log");
+    write(source.string() + "-journal", "unfinished");
+    write(target.string() + "-shm", "index");
+    const auto fingerprint = tools::database_fingerprint(source);
+    tools::copy_database(source, target);
+    REQUIRE(read(target) == "database");
+    REQUIRE(read(target.string() + "-wal") == "log");
+    REQUIRE_FALSE(std::filesystem::exists(target.string() + "-shm"));
+    REQUIRE_FALSE(std::filesystem::exists(target.string() + "-journal"));
+    write(source.string() + "-wal", "longer log");
+    REQUIRE(tools::database_fingerprint(source) != fingerprint);
+    std::filesystem::remove(source.string() + "-wal");
+    tools::copy_database(source, target);
+    REQUIRE_FALSE(std::filesystem::exists(target.string() + "-wal"));
+    tools::move_database(target, moved);
+    REQUIRE(read(moved) == "database");
+    REQUIRE_FALSE(std::filesystem::exists(target));
+    std::filesystem::remove(source);
+    std::filesystem::remove(source.string() + "-journal");
+    std::filesystem::remove(moved);
+}
+
+TEST_CASE("card queue")
+{
+    CardQueue queue;
+    auto make_cards = [](const std::string &prefix) {
+        std::vector<std::unique_ptr<Card>> cards;
+        for (int i = 0; i < 100; ++i) {
+            cards.push_back(std::make_unique<Card>());
+            cards.back()->set_front(prefix + std::to_string(i));
+        }
+        return cards;
+    };
+    queue.append(make_cards("a"));
+    auto &first = queue.at(0);
+    std::thread producer([&] {
+        for (int batch = 0; batch < 10; ++batch) {
+            queue.append(make_cards("b"));
+        }
+    });
+    std::thread refresher([&] {
+        for (int i = 0; i < 1000; ++i) {
+            first.set_back(std::to_string(i));
+        }
+    });
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(queue.at(i % queue.size()).snapshot().front.size() > 1);
+    }
+    producer.join();
+    refresher.join();
+    REQUIRE(queue.size() == 1100);
+    REQUIRE(&queue.at(0) == &first);
+    REQUIRE(first.get_back() == "999");
+    REQUIRE(queue.find("a42") == 42);
+    REQUIRE(queue.insert(1, std::make_unique<Card>()) == 1);
+    REQUIRE(queue.find("a42") == 43);
+}
+
+TEST_CASE("debouncer")
+{
+    std::atomic<int> runs = 0;
+    std::atomic<int> last = 0;
+    {
+        Debouncer debouncer(std::chrono::milliseconds(50));
+        for (int i = 1; i <= 10; ++i) {
+            debouncer.schedule([&, i](std::stop_token) {
+                ++runs;
+                last = i;
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        REQUIRE(runs == 1);
+        REQUIRE(last == 10);
+        debouncer.schedule([&](std::stop_token) { ++runs; });
+    }
+    REQUIRE(runs == 1);
+}
+
+TEST_CASE("event loop")
+{
+    // Coroutine lambdas take everything as parameters, as captures die with the lambda
+    using Events = std::vector<std::string>;
+    auto later = [](EventLoop &loop, int ms, Events &events) -> Task<int> {
+        co_await loop.sleep_for(std::chrono::milliseconds(ms));
+        events.push_back(std::to_string(ms));
+        co_return ms;
+    };
+    auto fail = [](EventLoop &loop) -> Task<void> {
+        co_await loop.sleep_for(std::chrono::milliseconds(1));
+        throw std::runtime_error("failed");
+    };
+    auto read = [](EventLoop &loop, int fd, Events &events) -> Task<void> {
+        co_await loop.readable(fd);
+        events.push_back("readable");
+    };
+    auto run = [](EventLoop &loop, int fd, Events &events, auto later, auto fail,
+                  std::promise<void> &done) -> Task<void> {
+        const auto first = co_await later(loop, 20, events);
+        const auto second = co_await later(loop, 10, events);
+        events.push_back(std::to_string(first + second));
+        [[maybe_unused]] auto res = ::write(fd, "x", 1);
+        co_await loop.sleep_for(std::chrono::milliseconds(10));
+        try {
+            co_await fail(loop);
+        }
+        catch (const std::runtime_error &e) {
+            events.push_back(e.what());
+        }
+        done.set_value();
+    };
+
+    EventLoop loop;
+    std::thread thread([&loop] {
+        loop.run();
+    });
+    int pipe_fds[2];
+    REQUIRE(::pipe(pipe_fds) == 0);
+    Events events;
+    std::promise<void> done;
+    loop.spawn(read(loop, pipe_fds[0], events));
+    loop.spawn(run(loop, pipe_fds[1], events, later, fail, done));
+    done.get_future().wait();
+    loop.stop();
+    thread.join();
+    ::close(pipe_fds[0]);
+    ::close(pipe_fds[1]);
+    REQUIRE(events == Events{"20", "10", "30", "readable", "failed"});
+
+    // The tasks still waiting are destroyed on stop
+    auto wait = [](EventLoop &loop, std::shared_ptr<int>) -> Task<void> {
+        co_await loop.sleep_for(std::chrono::hours(1));
+    };
+    auto guard = std::make_shared<int>();
+    EventLoop other;
+    std::thread other_thread([&other] {
+        other.run();
+    });
+    other.spawn(wait(other, guard));
+    other.post([&other] {
+        other.stop();
+    });
+    other_thread.join();
+    REQUIRE(guard.use_count() == 1);
+}
+
+TEST_CASE("latency histogram")
+{
+    using std::chrono::microseconds;
+    LatencyHistogram histogram;
+    REQUIRE(histogram.percentile(0.5) == microseconds(0));
+    for (int us = 1; us <= 1000; ++us) {
+        histogram.record(microseconds(us));
+    }
+    REQUIRE(histogram.count() == 1000);
+    // Within the bucket width of 12.5%
+    REQUIRE(histogram.percentile(0.5) >= microseconds(500));
+    REQUIRE(histogram.percentile(0.5) <= microseconds(563));
+    REQUIRE(histogram.percentile(0.99) >= microseconds(990));
+    REQUIRE(histogram.percentile(0.99) <= microseconds(1114));
+    REQUIRE(histogram.percentile(0.01) == microseconds(10));
+    const auto buckets = histogram.get_buckets();
+    REQUIRE(buckets.front() == std::pair{microseconds(1), uint64_t{1}});
+    uint64_t total = 0;
+    for (const auto &[upper_bound, count] : buckets) {
+        total += count;
+    }
+    REQUIRE(total == 1000);
+}
+
+TEST_CASE("memory stats")
+{
+    using Tag = MemoryStats::Tag;
+    REQUIRE(MemoryStats::is_enabled());
+    const auto json = MemoryStats::get(Tag::Json);
+    const auto cards = MemoryStats::get(Tag::Cards);
+    std::unique_ptr<char[]> block;
+    {
+        MemoryStats::Scope json_scope(Tag::Json);
+        {
+            MemoryStats::Scope cards_scope(Tag::Cards);
+            block = std::make_unique<char[]>(1000);
+        }
+        auto temporary = std::make_unique<char[]>(500);
+    }
+    auto json_after = MemoryStats::get(Tag::Json);
+    REQUIRE(json_after.allocations == json.allocations + 1);
+    REQUIRE(json_after.bytes == json.bytes + 500);
+    REQUIRE(json_after.live == json.live);
+    REQUIRE(json_after.peak >= json.live + 500);
+    auto cards_after = MemoryStats::get(Tag::Cards);
+    REQUIRE(cards_after.allocations == cards.allocations + 1);
+    REQUIRE(cards_after.bytes == cards.bytes + 1000);
+    REQUIRE(cards_after.live == cards.live + 1000);
+    REQUIRE(cards_after.peak >= cards_after.live);
+    {
+        // Freed bytes go back to the tag they were allocated under
+        MemoryStats::Scope json_scope(Tag::Json);
+        block.reset();
+    }
+    json_after = MemoryStats::get(Tag::Json);
+    REQUIRE(json_after.live == json.live);
+    cards_after = MemoryStats::get(Tag::Cards);
+    REQUIRE(cards_after.live == cards.live);
+    REQUIRE(cards_after.allocations == cards.allocations + 1);
+    const auto total = MemoryStats::get_total();
+    REQUIRE(total.live > 0);
+    REQUIRE(total.peak >= total.live);
+}
+
+TEST_CASE("pipeline")
+{
+    Pipeline<int> pipeline(4);
+    pipeline
+        .add_stage(
+            "odd",
+            [](int &value) {
+                return value % 2 == 1;
+            })
+        .add_stage(
+            "square",
+            [](int &value) {
+                value *= value;
+                return true;
+            },
+            4);
+    const auto source = [](const auto &emit) {
+        for (int i = 0; i < 100; ++i) {
+            emit(i);
+        }
+    };
+    const auto result = pipeline.run(source);
+    REQUIRE(result.size() == 50);
+    REQUIRE(std::is_sorted(result.begin(), result.end()));
+    REQUIRE(result.back() == 99 * 99);
+    const auto stats = pipeline.get_stats();
+    REQUIRE(stats.size() == 2);
+    REQUIRE(stats[0].items_in == 100);
+    REQUIRE(stats[0].items_out == 50);
+    REQUIRE(stats[1].workers == 4);
+    REQUIRE(stats[1].items_out == 50);
+
+    pipeline.add_stage("fail", [](int &) -> bool {
+        throw std::runtime_error("failed");
+    });
+    REQUIRE_THROWS_WITH(pipeline.run(source), "failed");
+}
+
+TEST_CASE("write behind queue")
+{
+    Card first, second;
+    std::vector<std::vector<WriteBehindQueue::Item>> batches;
+    std::mutex mutex;
+    std::unique_lock hold(mutex);
+    WriteBehindQueue queue(
+        [&](const auto &batch) {
+            std::lock_guard lock(mutex);
+            batches.push_back(batch);
+            for (const auto &item : batch) {
+                item.card->set_sync_status(Card::SyncStatus::Committed);
+            }
+        },
+        10);
+    std::atomic<int> flushed = 0;
+    const auto count_flushed = [&flushed] {
+        ++flushed;
+    };
+    queue.push(first, WriteBehindQueue::Add, count_flushed);
+    queue.push(second, WriteBehindQueue::Update);
+    queue.push(first, WriteBehindQueue::Update, count_flushed);
+    REQUIRE(first.get_sync_status() == Card::SyncStatus::Pending);
+    hold.unlock();
+    queue.wait_idle();
+    REQUIRE(flushed == 2);
+    // The updates of the first card merge unless its add is already flushing
+    size_t first_items = 0;
+    uint8_t first_operations = 0;
+    for (const auto &batch : batches) {
+        for (const auto &item : batch) {
+            if (item.card == &first) {
+                ++first_items;
+                first_operations |= item.operations;
+            }
+        }
+    }
+    REQUIRE(first_items <= 2);
+    REQUIRE(first_operations == (WriteBehindQueue::Add | WriteBehindQueue::Update));
+    REQUIRE(first.get_sync_status() == Card::SyncStatus::Committed);
+    REQUIRE(second.get_sync_status() == Card::SyncStatus::Committed);
+}
+
+TEST_CASE("skipped list")
+{
+    const auto filename =
+        std::filesystem::temp_directory_path().append("test_skipped_list.sst");
+    {
+        SkippedList list{filename};
+        for (int i = 0; i < 1000; ++i) {
+            list.insert("word" + std::to_string(i));
+        }
+        list.compact(true);
+        list.erase("word42");
+        list.insert("extra");
+    }
+    SkippedList list{filename};
+    REQUIRE(list.size() == 1000);
+    REQUIRE(list.contains("word999"));
+    REQUIRE(list.contains("extra"));
+    REQUIRE_FALSE(list.contains("word42"));
+    REQUIRE_FALSE(list.contains("word1000"));
+    list.compact(true);
+    REQUIRE(list.size() == 1000);
+    REQUIRE(list.contains("extra"));
+    REQUIRE_FALSE(list.contains("word42"));
+
+    // Changes logged by another process survive this one's merge
+    SkippedList other{filename};
+    other.insert("other");
+    list.insert("mine");
+    list.compact(true);
+    REQUIRE(list.contains("other"));
+    REQUIRE(SkippedList{filename}.size() == 1002);
+
+    std::filesystem::remove(filename);
+    std::filesystem::remove(filename.string() + ".lock");
+
+    {
+        SkippedList single{filename};
+        single.insert("word");
+        single.compact(true);
+    }
+    {
+        // The end offset of the only word, after the header and 64 Bloom filter bits
+        std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(6 * sizeof(uint32_t) + 8 + sizeof(uint32_t));
+        const uint32_t offset = UINT32_MAX;
+        file.write(reinterpret_cast<const char *>(&offset), sizeof(offset));
+    }
+    REQUIRE_THROWS_WITH(SkippedList{filename}, Catch::Contains("corrupted"));
+    std::filesystem::remove(filename);
+    std::filesystem::remove(filename.string() + ".lock");
+}
+
+TEST_CASE("anki tape")
+{
+    using std::chrono::microseconds;
+    const auto filename =
+        std::filesystem::temp_directory_path().append("test_anki_tape.bin").string();
+    {
+        AnkiTape tape{filename, AnkiTape::Mode::Record};
+        tape.record(
+            R"({"action":"findNotes","version":6})", R"({"result":[1],"error":null})",
+            microseconds(2000));
+        tape.record(
+            R"({"action":"findNotes","version":6})", R"({"result":[2],"error":null})",
+            microseconds(4000));
+    }
+    AnkiTape tape{filename, AnkiTape::Mode::Replay, 2};
+    REQUIRE(tape.is_replaying());
+    // Matched by content, whatever the formatting
+    auto exchange = tape.replay(R"({ "version": 6, "action": "findNotes" })");
+    REQUIRE(exchange.response == R"({"result":[1],"error":null})");
+    REQUIRE(exchange.latency == microseconds(1000));
+    REQUIRE(tape.replay(R"({"action":"findNotes","version":6})").latency.count() == 2000);
+    exchange = tape.replay(R"({"action":"findNotes","version":6})");
+    REQUIRE(exchange.response == R"({"result":[2],"error":null})");
+    REQUIRE_THROWS(tape.replay(R"({"action":"version","version":6})"));
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("anki client cache")
+{
+    using std::chrono::microseconds;
+    const auto filename =
+        std::filesystem::temp_directory_path().append("test_anki_cache.bin").string();
+    const auto find =
+        R"({"action":"findNotes","version":6,"params":{"query":"front:x"}})";
+    {
+        AnkiTape tape{filename, AnkiTape::Mode::Record};
+        tape.record(find, R"({"result":[1],"error":null})", microseconds(0));
+        tape.record(find, R"({"result":[2],"error":null})", microseconds(0));
+        tape.record(
+            R"({"action":"multi","version":6,"params":{"actions":[)"
+            R"({"action":"notesInfo","version":6,"params":{"notes":[1]}}]}})",
+            R"({"result":[{"result":[{}],"error":null}],"error":null})", microseconds(0));
+    }
+    AnkiClient client{std::make_shared<AnkiTape>(filename, AnkiTape::Mode::Replay, 0)};
+    REQUIRE(client.find_notes("front:x") == nlohmann::json{1});
+    const nlohmann::json read{
+        {"action", "notesInfo"},
+        {"version", 6},
+        {"params", {{"notes", {1}}}}
+    };
+    const auto actions = nlohmann::json::array({read});
+    client.request("multi", {{"actions", actions}});
+    // A multi that only reads keeps the cache
+    REQUIRE(client.find_notes("front:x") == nlohmann::json{1});
+    client.invalidate_notes({1});
+    REQUIRE(client.find_notes("front:x") == nlohmann::json{2});
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("anki collection")
+{
+    const auto filename =
+        std::filesystem::temp_directory_path().append("test_collection.anki2");
+    std::filesystem::remove(filename);
+    sqlite3 *db = nullptr;
+    REQUIRE(sqlite3_open(filename.c_str(), &db) == SQLITE_OK);
+    const auto rc = sqlite3_exec(db,
+        "CREATE TABLE decks (id INTEGER PRIMARY KEY, name TEXT);\n"
+        "CREATE TABLE fields (ntid INTEGER, ord INTEGER, name TEXT);\n"
+        "CREATE TABLE notes (id INTEGER PRIMARY KEY, mid INTEGER, mod INTEGER,\n"
+        "                    flds TEXT, tags TEXT);\n"
+        "CREATE TABLE cards (id INTEGER PRIMARY KEY, nid INTEGER, did INTEGER,\n"
+        "                    type INTEGER, queue INTEGER);\n"
+        "INSERT INTO decks VALUES (1, 'Vocab'), (2, 'Vocab' || char(31) || 'Verbs'),\n"
+        "                         (3, 'vocab' || char(31) || 'Nouns'), (4, 'Vocab2');\n"
+        "INSERT INTO fields VALUES (7, 0, 'Front'), (7, 1, 'Back');\n"
+        "INSERT INTO notes VALUES (1, 7, 100, 'run' || char(31) || 'move fast', ''),\n"
+        "                         (2, 7, 200, 'go' || char(31) || 'move', ' leech '),\n"
+        "                         (3, 7, 300, 'walk' || char(31) || 'move slow', ''),\n"
+        "                         (4, 7, 400, 'swim' || char(31) || 'float', '');\n"
+        "INSERT INTO cards VALUES (1, 1, 1, 2, 2), (2, 2, 2, 2, -1), (3, 3, 3, 0, 0),\n"
+        "                         (4, 4, 4, 2, 2);",
+        nullptr, nullptr, nullptr);
+    sqlite3_close(db);
+    REQUIRE(rc == SQLITE_OK);
+
+    const AnkiCollection collection{filename};
+    const auto fronts = [&collection](const AnkiCollection::Filter &filter) {
+        std::vector<std::string> result;
+        for (const auto &note : collection.notes_info(filter)) {
+            result.push_back(note["fields"]["Front"]["value"].get<std::string>());
+        }
+        return result;
+    };
+    AnkiCollection::Filter filter;
+    filter.deck = "Vocab";
+    REQUIRE(fronts(filter) == std::vector<std::string>{"run", "go"});
+    filter.deck = "vocab";
+    REQUIRE(fronts(filter) == std::vector<std::string>{"walk"});
+    filter.deck = "Voc_b";
+    REQUIRE(fronts(filter).empty());
+    filter.deck = "Vocab%";
+    REQUIRE(fronts(filter).empty());
+    filter.deck = "Vocab";
+    filter.cards = AnkiCollection::Cards::Suspended;
+    REQUIRE(fronts(filter) == std::vector<std::string>{"go"});
+    filter.cards = AnkiCollection::Cards::Any;
+    filter.tag = "leech";
+    REQUIRE(fronts(filter) == std::vector<std::string>{"go"});
+    filter.exclude_tag = true;
+    REQUIRE(fronts(filter) == std::vector<std::string>{"run"});
+    const auto notes = collection.notes_info(filter);
+    REQUIRE(notes[0]["noteId"] == 1);
+    REQUIRE(notes[0]["mod"] == 100);
+    REQUIRE(notes[0]["fields"]["Back"]["value"] == "move fast");
+    REQUIRE(notes[0]["tags"].empty());
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("batch controller")
+{
+    using std::chrono::milliseconds;
+    BatchController controller{{10, 60, 10, milliseconds(100), 1000}};
+    REQUIRE(controller.get_size() == 50);
+    controller.report(50, milliseconds(20), 100);
+    REQUIRE(controller.get_size() == 60);
+    controller.report(60, milliseconds(20), 100);
+    REQUIRE(controller.get_size() == 60);
+    // A partial batch does not grow the size
+    controller.report(5, milliseconds(20), 100);
+    REQUIRE(controller.get_size() == 60);
+    controller.report(60, milliseconds(200), 100);
+    REQUIRE(controller.get_size() == 30);
+    controller.report(30, milliseconds(20), 5000);
+    REQUIRE(controller.get_size() == 15);
+    controller.report(15, milliseconds(200), 100);
+    REQUIRE(controller.get_size() == 10);
+}
+
+TEST_CASE("anki client replays bulk requests")
+{
+    using std::chrono::microseconds;
+    const auto filename =
+        std::filesystem::temp_directory_path().append("test_anki_bulk.bin").string();
+    const auto make_multi = [](const char *first, const char *second) {
+        return fmt::format(
+            R"({{"action":"multi","version":6,"params":{{"actions":[)"
+            R"({{"action":"findNotes","version":6,"params":{{"query":"{}"}}}},)"
+            R"({{"action":"findNotes","version":6,"params":{{"query":"{}"}}}}]}}}})",
+            first, second);
+    };
+    const auto response = R"({"result":[{"result":[1],"error":null},)"
+                          R"({"result":[],"error":null}],"error":null})";
+    {
+        // Slower than the target, so a live controller would halve the second batch
+        AnkiTape tape{filename, AnkiTape::Mode::Record};
+        tape.record(make_multi("a", "b"), response, microseconds(5000));
+        tape.record(make_multi("c", "d"), response, microseconds(5000));
+    }
+    const BatchController::Limits limits{1, 2, 1, std::chrono::milliseconds(1), 1 << 20};
+    AnkiClient client{
+        std::make_shared<AnkiTape>(filename, AnkiTape::Mode::Replay, 2), limits};
+    const std::vector<nlohmann::json> params{
+        {{"query", "a"}}, {{"query", "b"}}, {{"query", "c"}}, {{"query", "d"}}};
+    const auto results = client.bulk_request("findNotes", params);
+    REQUIRE(results.size() == 4);
+    REQUIRE(results[2].at("result") == nlohmann::json{1});
+    REQUIRE(results[3].at("result").empty());
+    REQUIRE(client.get_batch_size("findNotes") == 2);
+    std::filesystem::remove(filename);
+}